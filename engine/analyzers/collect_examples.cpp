@@ -14,8 +14,11 @@
  * limitations under the License.
  */
 
+#include <atomic>
 #include <chrono>
 #include <fstream>
+#include <future>
+#include <iomanip>
 #include <random>
 #include "../board/bitpattern.h"
 #include "../board/board.h"
@@ -23,13 +26,15 @@
 #include "../hashmap/hash_map.h"
 #include "../evaluatedepthone/pattern_evaluator.h"
 #include "../evaluatederivative/evaluator_derivative.h"
+#include "../utils/files.h"
 #include "../utils/load_training_set.h"
 #include "../utils/parse_flags.h"
 
 class Collector {
  public:
 
-  Collector(int to_collect) : to_collect_(to_collect), total_(0), collected_(), seen_() {}
+  Collector(int to_collect, std::mt19937& rng) :
+      to_collect_(to_collect), total_(0), collected_(), seen_(), rng_(rng) {}
 
   void AddBoard(const Board& b) {
     if (seen_.find(b) != seen_.end()) {
@@ -44,8 +49,8 @@ class Collector {
     }
 
     // This happens with probability to_collect_ / total_.
-    if ((double) rand() / RAND_MAX < (double) to_collect_ / total_) {
-      collected_[rand() % collected_.size()] = b;
+    if (std::uniform_int_distribution<int>(1, total_)(rng_) <= to_collect_) {
+      collected_[rng_() % collected_.size()] = b;
     }
   }
 
@@ -56,126 +61,219 @@ class Collector {
   int total_;
   std::vector<Board> collected_;
   std::unordered_set<Board> seen_;
+  std::mt19937& rng_;
+};
+
+// The boards already in the output files (endgame_results*.txt), so that an
+// interrupted run can be restarted without evaluating them again. In the shard
+// files, the lines of a board only count once the empty line that ends them
+// is written; the older endgame_results_N.txt files are always complete.
+std::unordered_set<Board> DoneBoards(const std::string& prefix) {
+  std::unordered_set<Board> result;
+  for (const std::string& filepath : GetAllFiles(".", true, false)) {
+    std::string filename = Filename(filepath);
+    if (filename.rfind(prefix, 0) != 0 || !EndsWith(filename, ".txt")) {
+      continue;
+    }
+    bool needs_end = filename.find("_shard_") != std::string::npos;
+    std::ifstream input(filepath);
+    std::string line;
+    std::vector<Board> block;
+    while (std::getline(input, line)) {
+      std::stringstream line_stream(line);
+      BitPattern player;
+      BitPattern opponent;
+      if (line.empty()) {
+        result.insert(block.begin(), block.end());
+        block.clear();
+      } else if (line_stream >> player >> opponent) {
+        block.push_back(Board(player, opponent));
+      }
+    }
+    if (!needs_end) {
+      result.insert(block.begin(), block.end());
+    }
+  }
+  return result;
+}
+
+// Drops the lines of a board that was being written when the previous run
+// stopped, i.e. everything after the last empty line (or the header).
+void TruncateIncompleteBoard(const std::string& filepath) {
+  std::string content = LoadTextFile(filepath);
+  size_t end = content.rfind("\n\n");
+  end = end == std::string::npos ? content.find('\n') : end + 1;
+  if (end != std::string::npos && end + 1 < content.size()) {
+    fs::resize_file(filepath, end + 1);
+  }
+}
+
+// One of the independent workers: it has its own evaluators, HashMap,
+// TreeNodeSupplier and random generator, and appends to its own output file.
+class Shard {
+ public:
+  Shard(const EvalType& evals, const std::string& filename, int seed) :
+      hash_map_(std::make_unique<HashMap<kBitHashMap>>()),
+      tree_node_supplier_(std::make_unique<TreeNodeSupplier>()),
+      evaluator_(tree_node_supplier_.get(), hash_map_.get(), PatternEvaluator::Factory(evals.data()), 12),
+      evaluator0_(evals.data()),
+      evaluator_alpha_beta_(hash_map_.get(), PatternEvaluator::Factory(evals.data())),
+      filename_(filename),
+      rng_(seed) {
+    if (std::ifstream(filename_).good()) {
+      TruncateIncompleteBoard(filename_);
+    } else {
+      std::ofstream output(filename_, std::ios::app);
+      output
+          << "player opponent empties real_eval perc_lower solve_probability_lower "
+          << "perc_upper solve_probability_upper alpha_beta final_lower "
+          << "final_upper final_eval final_visited final_proof final_disproof "
+          << "final_weaklower final_weakupper eval0 eval1 eval2 eval3 eval4 "
+          << "moves_player moves_player_corner moves_player_x "
+          << "moves_player_app moves_player_corner_app moves_player_x_app "
+          << "moves_opponent moves_opponent_corner moves_opponent_x "
+          << "moves_opponent_app moves_opponent_corner_app moves_opponent_x_app\n";
+    }
+  }
+
+  void Run(const std::vector<Board>& boards, std::atomic_int& next_board) {
+    for (int i = next_board++; i < boards.size(); i = next_board++) {
+      std::string result = Evaluate(boards[i]);
+      // Each board is appended at once, ended by an empty line and flushed, so
+      // the output file is also the checkpoint used by DoneBoards().
+      std::ofstream output(filename_, std::ios::app);
+      output << result << "\n" << std::flush;
+      auto t = std::time(nullptr);
+      tm time;
+      localtime_r(&t, &time);
+      std::cout << std::put_time(&time, "%H:%M:%S") << " " << filename_
+                << ": board " << i + 1 << " / " << boards.size() << " ("
+                << boards[i].NEmpties() << " empties)\n" << std::flush;
+    }
+  }
+
+ private:
+  std::unique_ptr<HashMap<kBitHashMap>> hash_map_;
+  std::unique_ptr<TreeNodeSupplier> tree_node_supplier_;
+  EvaluatorDerivative evaluator_;
+  PatternEvaluator evaluator0_;
+  EvaluatorAlphaBeta evaluator_alpha_beta_;
+  std::string filename_;
+  std::mt19937 rng_;
+
+  std::string Evaluate(const Board& b) {
+    std::stringstream low_depth_evals;
+    evaluator0_.Setup(b.Player(), b.Opponent());
+    low_depth_evals << evaluator0_.Evaluate();
+    for (int d = 1; d <= 4; ++d) {
+      low_depth_evals << " " << evaluator_alpha_beta_.Evaluate(b.Player(), b.Opponent(), d);
+    }
+    for (bool invert : {false, true}) {
+      for (bool approx : {false, true}) {
+        BitPattern new_player = invert ? b.Opponent() : b.Player();
+        BitPattern new_opponent = invert ? b.Player() : b.Opponent();
+        BitPattern moves = approx ?
+            Neighbors(new_opponent) & ~(new_player | new_opponent)
+            : GetMoves(new_player, new_opponent);
+        low_depth_evals
+            << " " << __builtin_popcountll(moves)
+            << " " << __builtin_popcountll(moves & kCornerPattern)
+            << " " << __builtin_popcountll(moves & kXPattern);
+      }
+    }
+    tree_node_supplier_->Reset();
+    evaluator_.Evaluate(b.Player(), b.Opponent(), -63, 63, 1000000000000L, 300, 1, false);
+    auto first_position_ptr = evaluator_.GetFirstPosition();
+    assert(first_position_ptr);
+    auto first_position = *first_position_ptr;
+    double real_eval = first_position.GetEval();
+    double perc_lower = first_position.GetPercentileUpper(0.5F);
+    double solve_probability_lower = first_position.SolveProbabilityLower(-63);
+    double perc_upper = first_position.GetPercentileLower(0.5F);
+    double solve_probability_upper = first_position.SolveProbabilityUpper(63);
+    std::stringstream result;
+    int step = b.NEmpties() > 28 ? 3 : 1;
+    for (int i = -63 + (int) (rng_() % step) * 2; i <= 63; i += 2 * step) {
+      tree_node_supplier_->Reset();
+      hash_map_->Reset();
+      evaluator_.Evaluate(b.Player(), b.Opponent(), i, i, 1000000000000L, 20, 1, false);
+      auto first_position_ptr = evaluator_.GetFirstPosition();
+      assert(first_position_ptr);
+      auto first_position = *first_position_ptr;
+      result
+          << b.Player() << " " << b.Opponent() << " " << b.NEmpties()
+          << " " << real_eval << " " << perc_lower << " " << solve_probability_lower << " "
+          << perc_upper << " " << solve_probability_upper << " "
+          << i << " " << (int) first_position.Lower()
+          << " " << (int) first_position.Upper() << " " << first_position.GetEval()
+          << " " << first_position.GetNVisited() << " " << first_position.ProofNumber(i)
+          << " " << first_position.DisproofNumber(i) << " " << (int) first_position.WeakLower()
+          << " " << (int) first_position.WeakUpper() << " " << low_depth_evals.str() << "\n";
+    }
+    return result.str();
+  }
 };
 
 int main(int argc, char* argv[]) {
   ParseFlags parse_flags(argc, argv);
 //  int n = parse_flags.GetIntFlagOrDefault("n", 20);
+  int n_shards = parse_flags.GetIntFlagOrDefault("n_shards", 1);
+  std::string prefix = parse_flags.GetFlagOrDefault("output_prefix", "endgame_results");
+  int seed = parse_flags.GetIntFlagOrDefault("seed", 42);
+  // The sample must be the same at every restart, for DoneBoards() to work.
+  std::mt19937 rng(seed);
   std::vector<Collector> collectors;
   for (int i = 0; i < 64; ++i) {
     if (i <= 51) {
-      collectors.push_back(Collector(0));
+      collectors.push_back(Collector(0, rng));
 //    } else if (i <= 27) {
 //      // ~3 hours
 //      collectors.push_back(Collector(40));
     } else if (i == 52) {
       // ~1 hour
-      collectors.push_back(Collector(4));
+      collectors.push_back(Collector(4, rng));
     } else {
       // ~1 hour for 30, 2 hours for 31 (time cutoff), ...
-      collectors.push_back(Collector(15));
+      collectors.push_back(Collector(15, rng));
     }
   }
 
-  std::ofstream output;
-  HashMap<kBitHashMap> hash_map;
   auto evals = LoadEvals();
-  TreeNodeSupplier tree_node_supplier;
-  EvaluatorDerivative evaluator(&tree_node_supplier, &hash_map, PatternEvaluator::Factory(evals.data()), 12);
-  PatternEvaluator evaluator0(evals.data());
-  EvaluatorAlphaBeta evaluator_alpha_beta(&hash_map, PatternEvaluator::Factory(evals.data()));
 
   for (const auto& board : load_train_set()) {
     collectors[board.Empties()].AddBoard(board.GetBoard());
   }
 
-  std::string filename = "endgame_results.txt";
-  int index = 0;
-  while (std::ifstream(filename).good()) {
-    ++index;
-    filename = "endgame_results_" + std::to_string(index) + ".txt";
-  }
-  output.open(filename, std::ios::app);
-  output
-      << "player opponent empties real_eval perc_lower solve_probability_lower "
-      << "perc_upper solve_probability_upper alpha_beta final_lower "
-      << "final_upper final_eval final_visited final_proof final_disproof "
-      << "final_weaklower final_weakupper eval0 eval1 eval2 eval3 eval4 "
-      << "moves_player moves_player_corner moves_player_x "
-      << "moves_player_app moves_player_corner_app moves_player_x_app "
-      << "moves_opponent moves_opponent_corner moves_opponent_x "
-      << "moves_opponent_app moves_opponent_corner_app moves_opponent_x_app\n";
-  output.close();
+  std::unordered_set<Board> done = DoneBoards(prefix);
+  std::vector<Board> boards;
   for (Collector collector : collectors) {
-    const auto& boards = collector.Get();
-    if (boards.size() == 0) {
-      continue;
-    }
-    auto t = std::time(nullptr);
-    tm time;
-    localtime_r(&t, &time);
-    std::cout
-        << "\nStarting " << collector.Get()[0].NEmpties()
-        << "(" << boards.size() << ") at "
-        << std::put_time(&time, "%H:%M:%S") << "\n";
     for (const Board& b : collector.Get()) {
-      std::stringstream low_depth_evals;
-      evaluator0.Setup(b.Player(), b.Opponent());
-      low_depth_evals << evaluator0.Evaluate();
-      for (int d = 1; d <= 4; ++d) {
-        low_depth_evals << " " << evaluator_alpha_beta.Evaluate(b.Player(), b.Opponent(), d);
-      }
-      for (bool invert : {false, true}) {
-        for (bool approx : {false, true}) {
-          BitPattern new_player = invert ? b.Opponent() : b.Player();
-          BitPattern new_opponent = invert ? b.Player() : b.Opponent();
-          BitPattern moves = approx ?
-              Neighbors(new_opponent) & ~(new_player | new_opponent)
-              : GetMoves(new_player, new_opponent);
-          low_depth_evals
-              << " " << __builtin_popcountll(moves)
-              << " " << __builtin_popcountll(moves & kCornerPattern)
-              << " " << __builtin_popcountll(moves & kXPattern);
-        }
-      }
-      tree_node_supplier.Reset();
-      evaluator.Evaluate(b.Player(), b.Opponent(), -63, 63, 1000000000000L, 300, 1, false);
-      auto first_position_ptr = evaluator.GetFirstPosition();
-      assert(first_position_ptr);
-      auto first_position = *first_position_ptr;
-      double real_eval = first_position.GetEval();
-      double perc_lower = first_position.GetPercentileUpper(0.5F);
-      double solve_probability_lower = first_position.SolveProbabilityLower(-63);
-      double perc_upper = first_position.GetPercentileLower(0.5F);
-      double solve_probability_upper = first_position.SolveProbabilityUpper(63);
-      std::stringstream result;
-      int step = b.NEmpties() > 28 ? 3 : 1;
-      for (int i = -63 + (rand() % step) * 2; i <= 63; i += 2 * step) {
-        tree_node_supplier.Reset();
-        hash_map.Reset();
-        evaluator.Evaluate(b.Player(), b.Opponent(), i, i, 1000000000000L, 20, 1, false);
-        auto first_position_ptr = evaluator.GetFirstPosition();
-        assert(first_position_ptr);
-        auto first_position = *first_position_ptr;
-        result
-            << b.Player() << " " << b.Opponent() << " " << b.NEmpties()
-            << " " << real_eval << " " << perc_lower << " " << solve_probability_lower << " "
-            << perc_upper << " " << solve_probability_upper << " "
-            << i << " " << (int) first_position.Lower()
-            << " " << (int) first_position.Upper() << " " << first_position.GetEval()
-            << " " << first_position.GetNVisited() << " " << first_position.ProofNumber(i)
-            << " " << first_position.DisproofNumber(i) << " " << (int) first_position.WeakLower()
-            << " " << (int) first_position.WeakUpper() << " " << low_depth_evals.str() << "\n";
-        std::cout << "." << std::flush;
+      if (done.find(b) == done.end()) {
+        boards.push_back(b);
       }
-      std::cout << "\n" << std::flush;
-      output.open(filename, std::ios::app);
-      output << result.str();
-      output.close();
     }
-    t = std::time(nullptr);
-    localtime_r(&t, &time);
-    std::cout << "\nFinished at " << std::put_time(&time, "%H:%M:%S") << "\n";
   }
+  std::cout << "Found " << done.size() << " boards already evaluated, "
+            << boards.size() << " boards to go\n";
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  for (int i = 0; i < n_shards; ++i) {
+    shards.push_back(std::make_unique<Shard>(
+        evals, prefix + "_shard_" + std::to_string(i) + ".txt", seed + 1 + i));
+  }
+  std::atomic_int next_board = 0;
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < n_shards; ++i) {
+    futures.push_back(std::async(
+        std::launch::async, &Shard::Run, shards[i].get(), std::cref(boards),
+        std::ref(next_board)));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+  auto t = std::time(nullptr);
+  tm time;
+  localtime_r(&t, &time);
+  std::cout << "\nFinished at " << std::put_time(&time, "%H:%M:%S") << "\n";
   return 0;
-}
\ No newline at end of file
+}
@@ -27,6 +27,7 @@
 #include "endgame_ffo.h"
 
 #include <array>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include "../board/board.h"
@@ -43,13 +44,25 @@ int main(int argc, char* argv[]) {
   std::cout << "\nStarting setup...\n";
   ParseFlags parse_flags(argc, argv);
   int n_threads = parse_flags.GetIntFlagOrDefault("n_threads", 1);
+  int max_leaves_per_descent = parse_flags.GetIntFlagOrDefault("max_leaves_per_descent", 1);
   std::string board = parse_flags.GetFlag("board");
+  // If set, saves the tree to this file every snapshot_every_sec seconds and
+  // at the end, and resumes from it if it exists.
+  std::string snapshot = parse_flags.GetFlagOrDefault("snapshot", "");
+  double snapshot_every_sec = parse_flags.GetDoubleFlagOrDefault("snapshot_every_sec", 600);
+  // If set, writes the last events of each thread to this file, in the Chrome
+  // trace format.
+  std::string trace = parse_flags.GetFlagOrDefault("trace", "");
   PrintSupportedFeatures();
   using std::setw;
   HashMap<kBitHashMap> hash_map;
   auto evals = LoadEvals();
   TreeNodeSupplier tree_node_supplier;
   EvaluatorDerivative evaluator(&tree_node_supplier, &hash_map, PatternEvaluator::Factory(evals.data()));
+  evaluator.SetMaxLeavesPerDescent(max_leaves_per_descent);
+  if (!trace.empty()) {
+    evaluator.SetTraceCapacity(1 << 20);
+  }
   Board b;
   Sequence sequence = Sequence::ParseFromString(board);
   if (sequence.Size() != 0) {
@@ -65,9 +78,32 @@ int main(int argc, char* argv[]) {
   }
   std::cout << "\nEvaluating\n" << b << "Empties: " << b.NEmpties() << "\n";
   std::cout << "Finished setup after " << std::setprecision(2) << t_setup.Get() << " seconds..." << "\n\n" << std::flush;
+  constexpr double kMaxTime = 1200;
+  constexpr NVisited kMaxVisited = 1000000000000L;
+  double slice_time = snapshot.empty() ? kMaxTime : std::min(kMaxTime, snapshot_every_sec);
   ElapsedTime t;
-  evaluator.Evaluate(b.Player(), b.Opponent(), -63, 63, 1000000000000L, 1200, n_threads, false);
+  if (!snapshot.empty() && evaluator.LoadSnapshot(snapshot)) {
+    if (evaluator.GetFirstPosition()->ToBoard() != b) {
+      std::cout << "\nFAILED: The snapshot " << snapshot << " is for another board\n";
+      return 1;
+    }
+    std::cout << "Resuming from " << snapshot << "\n";
+    evaluator.ContinueEvaluate(kMaxVisited, slice_time, n_threads);
+  } else {
+    evaluator.Evaluate(b.Player(), b.Opponent(), -63, 63, kMaxVisited, slice_time, n_threads, false);
+  }
+  while (!snapshot.empty()) {
+    evaluator.SaveSnapshot(snapshot);
+    if (evaluator.GetStatus() != STOPPED_TIME || t.Get() >= kMaxTime) {
+      break;
+    }
+    evaluator.ContinueEvaluate(kMaxVisited, std::min(slice_time, kMaxTime - t.Get()), n_threads);
+  }
   double time = t.Get();
+  if (!trace.empty()) {
+    std::ofstream trace_file(trace);
+    evaluator.WriteTrace(trace_file);
+  }
   auto first_position_ptr = evaluator.GetFirstPosition();
   assert(first_position_ptr);
   auto first_position = *first_position_ptr;
@@ -78,5 +114,11 @@ int main(int argc, char* argv[]) {
       << "Time (sec):     " << setw(9) << std::setprecision(4) << time << "\n"
       << "Positions:  " << setw(13) << std::setprecision(0) << n_visited << "\n"
       << "Pos/sec:   " << setw(14) << static_cast<double>(n_visited / time) << "\n"
-      << "Eval:              " << setw(6) << std::setprecision(0) << first_position.GetEval() << "\n";
+      << "Descents:   " << setw(13) << stats.Get(NEXT_POSITION_SUCCESS) << "\n"
+      << "UpdateFather:" << setw(12) << stats.Get(UPDATE_FATHER) << "\n"
+      << "Descent (us):" << setw(12) << std::setprecision(2) << stats.TimeNextPosition() * 1000000 / stats.Get(NEXT_POSITION_SUCCESS) << "\n"
+      << "Eval:              " << setw(6) << std::setprecision(0) << first_position.GetEval() << "\n"
+      << "Arena (MB):    " << setw(10) << std::setprecision(1)
+      << tree_node_supplier.GetEvaluationArena().UsedBytes() / 1024.0 / 1024 << " used, "
+      << tree_node_supplier.GetEvaluationArena().AllocatedBytes() / 1024.0 / 1024 << " allocated\n";
 }
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OTHELLOSENSEI_APP_SRC_MAIN_CPP_ANALYZERS_GENERATE_TRAINING_SET_H_
+#define OTHELLOSENSEI_APP_SRC_MAIN_CPP_ANALYZERS_GENERATE_TRAINING_SET_H_
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include "../board/bitpattern.h"
+#include "../board/board.h"
+#include "../board/get_flip.h"
+#include "../board/get_moves.h"
+#include "../utils/load_training_set.h"
+
+// Appends boards to the output file in index order, buffering the ones that
+// arrive early.
+class OrderedWriter {
+ public:
+  OrderedWriter(const std::string& filepath, int64_t next_index) :
+      output_(filepath, std::ios::binary | std::ios::app),
+      next_index_(next_index) {}
+
+  void Add(int64_t index, const EvaluatedBoard& board) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    pending_[index] = board;
+    bool written = false;
+    for (auto it = pending_.begin();
+         it != pending_.end() && it->first == next_index_;
+         it = pending_.erase(it)) {
+      output_.write((const char*) &it->second, sizeof(EvaluatedBoard));
+      ++next_index_;
+      written = true;
+    }
+    if (written) {
+      output_.flush();
+    }
+  }
+
+  int64_t NextIndex() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return next_index_;
+  }
+
+ private:
+  std::ofstream output_;
+  std::mutex mutex_;
+  std::map<int64_t, EvaluatedBoard> pending_;
+  int64_t next_index_;
+};
+
+// Plays random moves from start until it has `empties` empties, and returns
+// the position with a legal move for the player. Returns nullopt if the game
+// ends before.
+inline std::optional<Board> RandomPlayout(Board b, int empties, std::mt19937_64& rng) {
+  while (true) {
+    BitPattern moves = GetMoves(b.Player(), b.Opponent());
+    if (moves == 0) {
+      if (GetMoves(b.Opponent(), b.Player()) == 0) {
+        return std::nullopt;
+      }
+      b = Board(b.Opponent(), b.Player());
+      continue;
+    }
+    if (b.NEmpties() <= empties) {
+      return b;
+    }
+    for (int i = (int) (rng() % __builtin_popcountll(moves)); i > 0; --i) {
+      moves &= moves - 1;
+    }
+    Square move = (Square) __builtin_ctzll(moves);
+    b.PlayMove(GetFlip(move, b.Player(), b.Opponent()));
+  }
+}
+
+// Picks the number of empties of position i in [min_empties, max_empties]
+// (it assumes 0 <= min_empties <= max_empties).
+inline int RandomEmpties(int min_empties, int max_empties, std::mt19937_64& rng) {
+  return min_empties + (int) (rng() % (max_empties - min_empties + 1));
+}
+
+#endif  // OTHELLOSENSEI_APP_SRC_MAIN_CPP_ANALYZERS_GENERATE_TRAINING_SET_H_
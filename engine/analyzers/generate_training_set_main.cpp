@@ -0,0 +1,212 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Generates labelled positions in the binary training set format (see
+// EvaluatedBoards), using n_threads workers with their own HashMap. Each
+// HashMap takes ~256MB, so the number of workers is capped to fit in
+// max_memory_mb.
+//
+// Usage:
+// cmake -S engine -B build -DANDROID=FALSE -DCMAKE_BUILD_TYPE=Release \
+//   && cmake --build build --parallel=12 --target=generate_training_set_main \
+//   && ./build/analyzers/generate_training_set_main \
+//        --output=testdata/training_set/generated.bin --source=xot \
+//        --xot_path="assets/xot/2 - Large list.txt" --n_positions=1000000 \
+//        --n_threads=16
+//
+// Sources:
+// - random: random playouts from the starting position;
+// - thor: positions from Thor games (load_train_set), then random moves;
+// - xot: XOT openings (one sequence per line), then random moves.
+// In all cases, the playout stops at a random number of empties in
+// [min_empties, max_empties].
+//
+// Labels:
+// - alpha_beta: EvaluatorAlphaBeta at the given depth (exact if depth >= empties);
+// - derivative: single-threaded EvaluatorDerivative with max_visited positions.
+//
+// Position i only depends on (seed, i), and positions are appended to the
+// output in order. Rerunning the same command after an interruption continues
+// from the first missing position.
+
+#include <atomic>
+#include <climits>
+#include <future>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "generate_training_set.h"
+#include "../board/board.h"
+#include "../board/sequence.h"
+#include "../hashmap/hash_map.h"
+#include "../evaluatedepthone/pattern_evaluator.h"
+#include "../evaluatederivative/evaluator_derivative.h"
+#include "../evaluatealphabeta/evaluator_alpha_beta.h"
+#include "../utils/files.h"
+#include "../utils/load_training_set.h"
+#include "../utils/misc.h"
+#include "../utils/parse_flags.h"
+
+class Worker {
+ public:
+  Worker(const EvalType& evals, const std::string& label, int depth,
+         NVisited max_visited) :
+      hash_map_(std::make_unique<HashMap<kBitHashMap>>()),
+      evaluator_alpha_beta_(hash_map_.get(),
+                            PatternEvaluator::Factory(evals.data())),
+      label_(label),
+      depth_(depth),
+      max_visited_(max_visited) {
+    if (label_ == "derivative") {
+      tree_node_supplier_ = std::make_unique<TreeNodeSupplier>();
+      evaluator_derivative_ = std::make_unique<EvaluatorDerivative>(
+          tree_node_supplier_.get(), hash_map_.get(),
+          PatternEvaluator::Factory(evals.data()));
+    }
+  }
+
+  Eval Label(const Board& b) {
+    if (evaluator_derivative_) {
+      tree_node_supplier_->Reset();
+      evaluator_derivative_->Evaluate(
+          b.Player(), b.Opponent(), -63, 63, max_visited_, 1000000, 1, false);
+      return (Eval) round(evaluator_derivative_->GetFirstPosition()->GetEval());
+    }
+    return EvalLargeToEvalRound(
+        evaluator_alpha_beta_.Evaluate(b.Player(), b.Opponent(), depth_));
+  }
+
+ private:
+  std::unique_ptr<HashMap<kBitHashMap>> hash_map_;
+  std::unique_ptr<TreeNodeSupplier> tree_node_supplier_;
+  EvaluatorAlphaBeta evaluator_alpha_beta_;
+  std::unique_ptr<EvaluatorDerivative> evaluator_derivative_;
+  std::string label_;
+  int depth_;
+  NVisited max_visited_;
+};
+
+int main(int argc, char* argv[]) {
+  ParseFlags parse_flags(argc, argv);
+  std::string output = parse_flags.GetFlag("output");
+  std::string source = parse_flags.GetFlagOrDefault("source", "random");
+  std::string label = parse_flags.GetFlagOrDefault("label", "alpha_beta");
+  int64_t n_positions = parse_flags.GetLongLongFlag("n_positions");
+  int n_threads = parse_flags.GetIntFlagOrDefault("n_threads", (int) std::thread::hardware_concurrency());
+  int min_empties = parse_flags.GetIntFlagOrDefault("min_empties", 4);
+  int max_empties = parse_flags.GetIntFlagOrDefault("max_empties", 59);
+  int depth = parse_flags.GetIntFlagOrDefault("depth", 8);
+  NVisited max_visited = parse_flags.GetLongLongFlagOrDefault("max_visited", 1000000);
+  int seed = parse_flags.GetIntFlagOrDefault("seed", 0);
+  int64_t max_memory_mb = parse_flags.GetLongLongFlagOrDefault("max_memory_mb", 8192);
+
+  if (min_empties < 1 || min_empties > max_empties || max_empties > 60) {
+    std::cout << "Need 1 <= min_empties <= max_empties <= 60, got "
+              << min_empties << " and " << max_empties << "\n";
+    return 1;
+  }
+  if (label != "alpha_beta" && label != "derivative") {
+    std::cout << "Need label alpha_beta or derivative, got " << label << "\n";
+    return 1;
+  }
+  if (n_positions < 0) {
+    std::cout << "Need n_positions >= 0, got " << n_positions << "\n";
+    return 1;
+  }
+  int64_t hash_map_mb = (int64_t) (sizeof(HashMapEntryInternal) << kBitHashMap) >> 20;
+  int max_threads = (int) std::min((int64_t) INT_MAX, max_memory_mb / hash_map_mb);
+  if (max_threads < 1) {
+    std::cout << "Need max_memory_mb >= " << hash_map_mb << " (one HashMap)\n";
+    return 1;
+  }
+  if (n_threads > max_threads) {
+    std::cout << "Using " << max_threads << " threads instead of " << n_threads
+              << " to fit in " << max_memory_mb << "MB\n";
+  }
+  n_threads = std::max(1, std::min(n_threads, max_threads));
+
+  std::vector<Board> starts;
+  if (source == "random") {
+    starts.push_back(Board());
+  } else if (source == "thor") {
+    for (const EvaluatedBoard& b : load_train_set()) {
+      if (b.Empties() >= min_empties) {
+        starts.push_back(b.GetBoard());
+      }
+    }
+  } else if (source == "xot") {
+    for (const std::string& line : Split(LoadTextFile(parse_flags.GetFlag("xot_path")), '\n')) {
+      if (!line.empty()) {
+        starts.push_back(Sequence(line).ToBoard());
+      }
+    }
+  } else {
+    std::cout << "Unknown source " << source << "\n";
+    return 1;
+  }
+  if (starts.empty()) {
+    std::cout << "No starting positions for source " << source << "\n";
+    return 1;
+  }
+
+  if (!FileExists(output)) {
+    CreateEmptyFileWithDirectories(output);
+    save_binary_set({}, output);
+  }
+  size_t header_size = binary_set_header_size(output);
+  if (header_size == 0) {
+    std::cout << output << " is not a binary training set\n";
+    return 1;
+  }
+  // Drop a partial record left by an interrupted run.
+  int64_t done = (int64_t) ((fs::file_size(output) - header_size) / sizeof(EvaluatedBoard));
+  fs::resize_file(output, header_size + done * sizeof(EvaluatedBoard));
+  std::cout << "Found " << done << " positions in " << output << "\n";
+
+  auto evals = LoadEvals();
+  OrderedWriter writer(output, done);
+  std::atomic_int64_t next_index(done);
+  ElapsedTime elapsed_time;
+
+  auto run_worker = [&]() {
+    Worker worker(evals, label, depth, max_visited);
+    for (int64_t i = next_index++; i < n_positions; i = next_index++) {
+      std::seed_seq seed_sequence {seed, (int) (i >> 32), (int) i};
+      std::mt19937_64 rng(seed_sequence);
+      std::optional<Board> b;
+      while (!b) {
+        Board start = starts[rng() % starts.size()];
+        int empties = RandomEmpties(min_empties, max_empties, rng);
+        b = RandomPlayout(start, empties, rng);
+      }
+      writer.Add(i, EvaluatedBoard(b->Player(), b->Opponent(), worker.Label(*b)));
+      if (i % 1000 == 0) {
+        std::cout << elapsed_time.Get() << ": " << i << " positions ("
+                  << (i - done) / elapsed_time.Get() << " / sec)\n" << std::flush;
+      }
+    }
+  };
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < n_threads; ++i) {
+    futures.push_back(std::async(std::launch::async, run_worker));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+  std::cout << "Done: " << writer.NextIndex() << " positions in " << output
+            << " after " << elapsed_time.Get() << " sec\n";
+  return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include "generate_training_set.h"
+
+const std::string kTempDir = "app/testdata/tmp/generate_training_set_test";
+
+TEST(GenerateTrainingSet, RandomPlayout) {
+  for (int i = 0; i < 100; ++i) {
+    std::mt19937_64 rng(i);
+    int empties = RandomEmpties(1, 59, rng);
+    std::optional<Board> b = RandomPlayout(Board(), empties, rng);
+    if (!b) {
+      continue;
+    }
+    EXPECT_LE(b->NEmpties(), empties);
+    EXPECT_NE(GetMoves(b->Player(), b->Opponent()), 0);
+
+    std::mt19937_64 rng_again(i);
+    RandomEmpties(1, 59, rng_again);
+    EXPECT_EQ(RandomPlayout(Board(), empties, rng_again), b);
+  }
+}
+
+TEST(GenerateTrainingSet, RandomEmpties) {
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < 1000; ++i) {
+    int empties = RandomEmpties(10, 12, rng);
+    EXPECT_GE(empties, 10);
+    EXPECT_LE(empties, 12);
+    EXPECT_EQ(RandomEmpties(20, 20, rng), 20);
+  }
+}
+
+TEST(GenerateTrainingSet, OrderedWriter) {
+  std::string filename = kTempDir + "/set.bin";
+  CreateEmptyFileWithDirectories(filename);
+  std::vector<EvaluatedBoard> boards = {
+      EvaluatedBoard(1, 2, 10), EvaluatedBoard(4, 8, -20), EvaluatedBoard(16, 32, 30)};
+  save_binary_set({boards[0]}, filename);
+  {
+    OrderedWriter writer(filename, 1);
+    writer.Add(2, boards[2]);
+    EXPECT_EQ(writer.NextIndex(), 1);
+    EXPECT_EQ(EvaluatedBoards(filename).size(), 1);
+    writer.Add(1, boards[1]);
+    EXPECT_EQ(writer.NextIndex(), 3);
+  }
+  std::vector<EvaluatedBoard> result;
+  for (const EvaluatedBoard& b : EvaluatedBoards(filename)) {
+    result.push_back(b);
+  }
+  EXPECT_EQ(result, boards);
+}
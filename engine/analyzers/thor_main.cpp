@@ -130,7 +130,7 @@ class EvaluateThor {
  private:
   double sum_error_squared_;
   int num_boards_;
-  std::vector<EvaluatedBoard> boards_;
+  EvaluatedBoards boards_;
   NVisited n_visited_;
   ElapsedTime elapsed_time_;
   int positions_with_empties_[60];
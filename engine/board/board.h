@@ -149,7 +149,10 @@ class Board {
     return serialized;
   }
 
-  static Board Deserialize(std::vector<char>::const_iterator serialized) {
+  // Works with any iterator on chars (e.g., a std::vector<char> or a pointer
+  // to a memory mapped file).
+  template<class InputIt>
+  static Board Deserialize(InputIt serialized) {
     BitPattern player = 0;
     BitPattern opponent = 0;
     BitPattern current_square = 1ULL << 63;
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OTHELLOSENSEI_BLOOM_FILTER_H
+#define OTHELLOSENSEI_BLOOM_FILTER_H
+
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+// Blocked Bloom filter on 32-bit keys: all the bits of a key are in the same
+// 64-byte block, so a lookup reads one cache line. With kBitsPerKey bits per
+// key (at capacity), the false positive rate is about 1%.
+class BloomFilter {
+ public:
+  static constexpr int kBitsPerKey = 10;
+  static constexpr int kNumProbes = 6;
+  static constexpr int kWordsPerBlock = 8;
+  static constexpr int kBitsPerBlock = 64 * kWordsPerBlock;
+
+  BloomFilter() : n_keys_(0) { Reset(0); }
+
+  // Empties the filter, with space for `capacity` keys.
+  void Reset(uint64_t capacity) {
+    blocks_.assign(std::max((uint64_t) 1, (capacity * kBitsPerKey + kBitsPerBlock - 1) / kBitsPerBlock), Block());
+    n_keys_ = 0;
+  }
+
+  uint64_t Capacity() const { return blocks_.size() * kBitsPerBlock / kBitsPerKey; }
+  uint64_t NKeys() const { return n_keys_; }
+
+  void Add(uint32_t key) {
+    uint64_t hash = Mix(key);
+    Block& block = blocks_[BlockIndex(hash)];
+    for (int i = 0; i < kNumProbes; ++i) {
+      int bit = (int) (hash >> (9 * i)) & (kBitsPerBlock - 1);
+      block.words[bit / 64] |= 1ULL << (bit % 64);
+    }
+    ++n_keys_;
+  }
+
+  // False if the key was never added; true if it was added, or (rarely) if it
+  // was not.
+  bool MayContain(uint32_t key) const {
+    uint64_t hash = Mix(key);
+    const Block& block = blocks_[BlockIndex(hash)];
+    for (int i = 0; i < kNumProbes; ++i) {
+      int bit = (int) (hash >> (9 * i)) & (kBitsPerBlock - 1);
+      if ((block.words[bit / 64] & (1ULL << (bit % 64))) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Format: number of keys, number of blocks, blocks.
+  std::vector<char> Serialize() const {
+    uint64_t n_blocks = blocks_.size();
+    std::vector<char> result(2 * sizeof(uint64_t) + n_blocks * sizeof(Block));
+    memcpy(result.data(), &n_keys_, sizeof(uint64_t));
+    memcpy(result.data() + sizeof(uint64_t), &n_blocks, sizeof(uint64_t));
+    memcpy(result.data() + 2 * sizeof(uint64_t), blocks_.data(), n_blocks * sizeof(Block));
+    return result;
+  }
+
+  // Returns false (and leaves the filter unchanged) if serialized is not a
+  // valid filter.
+  bool Deserialize(const std::vector<char>& serialized) {
+    uint64_t n_keys;
+    uint64_t n_blocks;
+    if (serialized.size() < 2 * sizeof(uint64_t)) {
+      return false;
+    }
+    memcpy(&n_keys, serialized.data(), sizeof(uint64_t));
+    memcpy(&n_blocks, serialized.data() + sizeof(uint64_t), sizeof(uint64_t));
+    if (n_blocks == 0 || serialized.size() != 2 * sizeof(uint64_t) + n_blocks * sizeof(Block)) {
+      return false;
+    }
+    blocks_.resize(n_blocks);
+    memcpy(blocks_.data(), serialized.data() + 2 * sizeof(uint64_t), n_blocks * sizeof(Block));
+    n_keys_ = n_keys;
+    return true;
+  }
+
+ private:
+  struct alignas(64) Block {
+    uint64_t words[kWordsPerBlock] = {0};
+  };
+  static_assert(sizeof(Block) == 64);
+
+  std::vector<Block> blocks_;
+  uint64_t n_keys_;
+
+  // Spreads the key on 64 bits (splitmix64 finalizer): the high bits choose
+  // the block, the low 54 bits the probes.
+  static uint64_t Mix(uint32_t key) {
+    uint64_t hash = key + 0x9E3779B97F4A7C15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+  }
+
+  // Maps the high 32 bits to [0, n_blocks) without a division.
+  uint64_t BlockIndex(uint64_t hash) const {
+    return ((hash >> 32) * blocks_.size()) >> 32;
+  }
+};
+
+#endif  // OTHELLOSENSEI_BLOOM_FILTER_H
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <random>
+#include "bloom_filter.h"
+
+TEST(BloomFilterTest, NoFalseNegatives) {
+  BloomFilter filter;
+  filter.Reset(1000);
+  std::mt19937 rng(42);
+  std::vector<uint32_t> keys;
+  for (int i = 0; i < 1000; ++i) {
+    keys.push_back(rng());
+    filter.Add(keys.back());
+  }
+  EXPECT_EQ(filter.NKeys(), 1000);
+  for (uint32_t key : keys) {
+    EXPECT_TRUE(filter.MayContain(key));
+  }
+}
+
+TEST(BloomFilterTest, FalsePositiveRate) {
+  BloomFilter filter;
+  filter.Reset(10000);
+  for (uint32_t key = 0; key < 10000; ++key) {
+    filter.Add(key);
+  }
+  int false_positives = 0;
+  for (uint32_t key = 10000; key < 110000; ++key) {
+    false_positives += filter.MayContain(key) ? 1 : 0;
+  }
+  EXPECT_LT(false_positives, 3000);
+}
+
+TEST(BloomFilterTest, Serialize) {
+  BloomFilter filter;
+  filter.Reset(100);
+  for (uint32_t key = 0; key < 100; ++key) {
+    filter.Add(key * 7919);
+  }
+  BloomFilter other;
+  ASSERT_TRUE(other.Deserialize(filter.Serialize()));
+  EXPECT_EQ(other.NKeys(), 100);
+  EXPECT_EQ(other.Capacity(), filter.Capacity());
+  for (uint32_t key = 0; key < 1000; ++key) {
+    EXPECT_EQ(other.MayContain(key * 7919), filter.MayContain(key * 7919));
+  }
+}
+
+TEST(BloomFilterTest, DeserializeInvalid) {
+  BloomFilter filter;
+  filter.Add(1);
+  std::vector<char> serialized = filter.Serialize();
+  serialized.pop_back();
+  EXPECT_FALSE(filter.Deserialize(serialized));
+  EXPECT_FALSE(filter.Deserialize({}));
+  EXPECT_TRUE(filter.MayContain(1));
+}
@@ -18,20 +18,30 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cstring>
+#include <future>
 #include <iterator>
+#include <map>
 #include <memory>
 #include <optional>
 #include <signal.h>
 #include <stdio.h>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
+#include "bloom_filter.h"
 #include "book_tree_node.h"
+#include "commit_log.h"
+#include "frozen_book.h"
+#include "lru_cache.h"
 #include "value_file.h"
 #include "../board/bitpattern.h"
 #include "../board/board.h"
-#include "../utils/misc.h"
 #include "../utils/constants.h"
+#include "../utils/files.h"
+#include "../utils/misc.h"
 
 constexpr int kMinFileSize = kMinValueFileSize;
 constexpr int kMaxFileSize = 524288; // 2^19
@@ -40,6 +50,9 @@ constexpr char kBookFilepath[] = "book";
 typedef uint64_t HashMapIndex;
 
 constexpr HashMapIndex kInitialHashMapSize = 8;
+// The index grows when it is fuller than kMaxLoadFactor, to kLoadFactorAfterGrowth.
+constexpr double kMaxLoadFactor = 0.4;
+constexpr double kLoadFactorAfterGrowth = 0.3;
 constexpr HashMapIndex kNumElementsOffset = sizeof(HashMapIndex) / sizeof(char);
 constexpr HashMapIndex kOffset = 2 * sizeof(HashMapIndex) / sizeof(char);
 
@@ -89,11 +102,22 @@ class Book {
  public:
   typedef BookTreeNode<Book, version> BookNode;
 
+  // If the folder contains a frozen book (see Freeze()), it is opened
+  // read-only, and the methods that change the book must not be called.
+  // Throws std::invalid_argument if the frozen book is invalid, or if the
+  // folder also contains a normal book.
   Book(const std::string& folder);
 
   // TODO: Remove code duplication between Get and Mutable.
+  // This is thread safe, as long as there are no concurrent modifications.
   std::unique_ptr<Node> Get(const Board& b) const;
 
+  // Caches the last `capacity` results of Get() (0 disables the cache). The
+  // cache is cleared on Commit().
+  void SetCacheCapacity(size_t capacity) { cache_->SetCapacity(capacity); }
+  uint64_t CacheHits() const { return cache_->Hits(); }
+  uint64_t CacheMisses() const { return cache_->Misses(); }
+
   std::unique_ptr<Node> Get(BitPattern player, BitPattern opponent) const {
     return Get(Board(player, opponent));
   }
@@ -105,9 +129,13 @@ class Book {
     if (iterator != modified_nodes_.end()) {
       return iterator->second.get();
     }
-    HashMapNode node = Find(unique.Player(), unique.Opponent()).second;
+    assert(!IsFrozen());
+    if (!filter_.MayContain(HashFull(unique.Player(), unique.Opponent()))) {
+      return nullptr;
+    }
+    ValueSpan serialized;
+    HashMapNode node = Find(unique.Player(), unique.Opponent(), &serialized).second;
     if (!node.IsEmpty()) {
-      std::vector<char> serialized = GetValueFile(node).Get(node.Offset());
       std::unique_ptr<BookNode> book_node = BookNode::Deserialize(this, serialized);
       iterator = modified_nodes_.insert(std::make_pair(unique, std::move(book_node))).first;
       return iterator->second.get();
@@ -119,7 +147,16 @@ class Book {
 
   void AddChildren(const Board& father_board, const std::vector<Node>& children);
 
-  void Commit(bool verbose = false);
+  // Writes the modified nodes to the files. The writes are saved in a commit
+  // log before touching the book, so that a crash in the middle is fixed on
+  // the next open (see CommitLog). Returns false if the log cannot be saved
+  // or applied: the modified nodes stay in memory, and the next Commit()
+  // tries again (after applying the log, if it was saved).
+  bool Commit(bool verbose = false);
+
+  // Number of nodes written by the last Commit(), and its duration.
+  HashMapIndex LastCommitSize() const { return last_commit_size_; }
+  double LastCommitSeconds() const { return last_commit_seconds_; }
 
   bool IsSizeOK();
 
@@ -129,17 +166,44 @@ class Book {
 
   HashMapIndex Size() const { return book_size_; }
 
+  bool IsFrozen() const { return frozen_ != nullptr; }
+
+  // Writes the committed nodes to a frozen book in folder, which can be opened
+  // with Book(folder): a single file, with the nodes sorted by hash, without
+  // the fathers and without padding (see FrozenBook). Returns false (without
+  // writing anything) if folder is this book's folder or contains a book.
+  bool Freeze(const std::string& folder) const;
+
   const std::unordered_set<Board>& Roots() const {
     return roots_;
   }
 
+  // Calls visit(node, thread) on each committed node, reading the value files
+  // (or the frozen book) sequentially instead of looking up the nodes one by
+  // one: the order is the one in the files, not the one in the tree. The nodes
+  // are deserialized in batches on n_threads threads (at least 1). thread is
+  // in [0, std::max(1, n_threads)), and two calls with the same thread never
+  // run at the same time, so visit can keep one result per thread without
+  // locks.
+  template<class Visit>
+  void Scan(Visit visit, int n_threads = 1) const;
+
   void ReloadSizes() {
+    assert(!IsFrozen());
     auto index_file = IndexFile();
     index_file.read((char*) &hash_map_size_, sizeof(hash_map_size_));
     index_file.read((char*) &book_size_, sizeof(book_size_));
+    index_file.close();
+    if (AreHashesOK()) {
+      MapIndex();
+    } else {
+      RebuildHashes();
+    }
+    LoadFilter();
   }
 
   void LoadEverythingInMemory(bool load_if(const Node& node)) {
+    assert(!IsFrozen());
     for (const ValueFile& value_file : value_files_) {
       for (auto& [offset, serialized] : value_file) {
         std::vector<CompressedFlip> father_flips;
@@ -162,10 +226,25 @@ class Book {
   template<int, int> friend class BookVisitorMerge;
   std::string folder_;
   std::vector<ValueFile> value_files_;
-  ValueFile roots_file_;
+  // Not created if the book is frozen.
+  std::unique_ptr<ValueFile> roots_file_;
+  std::unique_ptr<FrozenBook> frozen_;
   std::unordered_set<Board> roots_;
   HashMapIndex hash_map_size_;
   HashMapIndex book_size_;
+  // Read-only views of the index and of the hashes, used for lookups. Writes
+  // go through IndexFile() and HashesFile(), and the views are remapped when
+  // the files grow.
+  std::unique_ptr<MappedFile> index_map_;
+  std::unique_ptr<MappedFile> hashes_map_;
+  // Contains the HashFull() of all the committed boards, so that most lookups
+  // of boards not in the book stop before probing the index.
+  BloomFilter filter_;
+  HashMapIndex last_commit_size_ = 0;
+  double last_commit_seconds_ = 0;
+  // Committed nodes returned by Get() (nullptr if not in the book). In a
+  // unique_ptr, so that the Book stays movable.
+  std::unique_ptr<LruCache<Board, std::shared_ptr<const Node>>> cache_;
   // References are not invalidated:
   // https://stackoverflow.com/questions/39868640/stdunordered-map-pointers-reference-invalidation
   std::unordered_map<Board, std::unique_ptr<BookNode>> modified_nodes_;
@@ -175,23 +254,97 @@ class Book {
   // signals come at the same time (not sure if it's really needed).
   static std::atomic_int received_signal_;
 
-  void Commit(const BookNode& node);
+  // Files addressed by the commit log.
+  static constexpr int kIndexFile = 0;
+  static constexpr int kHashesFile = 1;
+  static constexpr int kRootsFile = 2;
+  static constexpr int kFirstValueFile = 3;
+  std::vector<std::string> CommitLogFiles() const {
+    std::vector<std::string> result = {IndexFilename(), HashesFilename(), roots_file_->Filename()};
+    for (const ValueFile& value_file : value_files_) {
+      result.push_back(value_file.Filename());
+    }
+    return result;
+  }
+  std::string CommitLogFilename() const { return folder_ + "/commit_log.sen"; }
+
+  // Finishes the commit interrupted by a crash, if any.
+  void RecoverCommit() {
+    CommitLog log(CommitLogFiles());
+    if (log.Load(CommitLogFilename()) && !log.Apply()) {
+      std::cout << "Could not apply " << CommitLogFilename() << ", keeping it\n";
+      return;
+    }
+    remove(CommitLogFilename().c_str());
+  }
+
+  // Returns the writes that commit modified_nodes_, and updates book_size_ and
+  // the filter. It only writes to the files to grow the index.
+  CommitLog PlanCommit();
+
+  // Saves and applies the commit log of modified_nodes_. On failure, restores
+  // book_size_ and the filter, and returns false.
+  bool WriteCommit();
+
+  // Makes room in the index for new boards with the given hashes.
+  void Grow(const std::vector<uint32_t>& new_hashes) {
+    HashMapIndex n_elements = book_size_ + new_hashes.size();
+    HashMapIndex size = hash_map_size_;
+    if (n_elements > kMaxLoadFactor * size) {
+      size = (HashMapIndex) (n_elements / kLoadFactorAfterGrowth) + 1;
+    }
+    Rehash(size, new_hashes);
+  }
 
   static void HandleSignal(int signal) { received_signal_ = signal; }
 
   BookNode GetBookNode(HashMapNode node);
 
+  std::unique_ptr<Node> GetFromFiles(const Board& unique) const;
+
   BookNode* AddNoRootsUpdate(const TreeNode& node);
 
   int GetValueFileOffset(int size);
 
   const ValueFile& GetValueFile(const HashMapNode& node) const;
 
-  ValueFile& MutableValueFile(const HashMapNode& node) {
-    return const_cast<ValueFile&>(GetValueFile(node));
+  void UpdateSizes(std::fstream& file);
+
+  void MapIndex() {
+    UnmapIndex();
+    index_map_ = std::make_unique<MappedFile>(IndexFilename());
+    hashes_map_ = std::make_unique<MappedFile>(HashesFilename());
+    assert(index_map_->Size() == OffsetToFilePosition(hash_map_size_));
+    assert(hashes_map_->Size() == HashOffsetToFilePosition(hash_map_size_));
   }
 
-  void UpdateSizes(std::fstream& file);
+  void UnmapIndex() {
+    index_map_.reset();
+    hashes_map_.reset();
+  }
+
+  const HashMapNode* IndexSlots() const {
+    return (const HashMapNode*) (index_map_->Data() + kOffset);
+  }
+
+  const uint32_t* HashSlots() const {
+    return (const uint32_t*) (hashes_map_->Data() + kOffset);
+  }
+
+  bool AreHashesOK() const;
+
+  void RebuildHashes();
+
+  void LoadFilter();
+
+  // Rebuilds the filter from the hashes, with room for the book to double.
+  void RebuildFilter();
+
+  void SaveFilter() const {
+    std::vector<char> serialized = filter_.Serialize();
+    std::ofstream(FilterFilename(), std::ios::binary | std::ios::out | std::ios::trunc)
+        .write(serialized.data(), serialized.size());
+  }
 
   std::vector<BookNode> MissingChildren(const Board& b, const std::vector<BookNode*>& children);
 
@@ -204,6 +357,16 @@ class Book {
   std::fstream IndexFile() const {
     return std::fstream(IndexFilename(), std::ios::binary | std::ios::out | std::ios::in);
   }
+  // HashFull() of the board in each slot of the index, with the same header.
+  // Probes compare these instead of reading the candidates in the value files.
+  uint64_t HashOffsetToFilePosition(HashMapIndex offset) const {
+    return kOffset + offset * sizeof(uint32_t) / sizeof(char);
+  }
+  std::string HashesFilename() const { return folder_ + "/hashes.sen"; }
+  std::fstream HashesFile() const {
+    return std::fstream(HashesFilename(), std::ios::binary | std::ios::out | std::ios::in);
+  }
+  std::string FilterFilename() const { return folder_ + "/index_filter.sen"; }
 
   HashMapIndex PowerAfterHashMapSize() const {
     return 1ULL << (sizeof(HashMapIndex) * 8 - __builtin_clzll(hash_map_size_ - 1));
@@ -215,23 +378,46 @@ class Book {
 
   HashMapIndex RepositionHash(HashMapIndex board_hash) const;
 
-  std::pair<std::fstream, HashMapNode> Find(BitPattern player, BitPattern opponent) const;
+  // Returns the slot of the board and its node, or the first empty slot and an
+  // empty node if the board is not in the book (the slot is hash_map_size_ if
+  // the probe reaches the end of the index). If serialized is not null and the
+  // board is in the book, it also returns a view of its value in the value file.
+  std::pair<HashMapIndex, HashMapNode> Find(BitPattern player, BitPattern opponent, ValueSpan* serialized = nullptr) const;
 
-  void Resize(std::fstream& file, std::vector<HashMapNode> add_elements);
+  // Rebuilds the index and the hashes with at least `size` slots, enough to
+  // also add boards with new_hashes without reaching the end.
+  void Rehash(HashMapIndex size, const std::vector<uint32_t>& new_hashes = {});
 };
 
 template<int version>
 std::atomic_int Book<version>::received_signal_(NSIG);
 
 template<int version>
-Book<version>::Book(const std::string& folder) : folder_(folder), value_files_(), roots_file_(folder + "/roots.val", kSerializedBoardSize), roots_() {
+Book<version>::Book(const std::string& folder) :
+    folder_(folder),
+    value_files_(),
+    roots_(),
+    hash_map_size_(0),
+    book_size_(0),
+    cache_(std::make_unique<LruCache<Board, std::shared_ptr<const Node>>>()) {
+  if (FileExists(FrozenBook::Filename(folder))) {
+    if (FileExists(IndexFilename())) {
+      throw std::invalid_argument(folder + " contains both a frozen and a normal book");
+    }
+    frozen_ = std::make_unique<FrozenBook>(FrozenBook::Filename(folder));
+    roots_.insert(frozen_->Roots().begin(), frozen_->Roots().end());
+    book_size_ = frozen_->Size();
+    return;
+  }
+  roots_file_ = std::make_unique<ValueFile>(folder + "/roots.val", kSerializedBoardSize);
   for (int i = 1; i <= 255; ++i) {
     int size = HashMapNode::ByteToSize(i);
     std::string filename = folder + "/value_" + std::to_string(size) + ".val";
     value_files_.push_back(ValueFile(filename, size));
   }
+  RecoverCommit();
 
-  for (const auto& offset_serialized : roots_file_) {
+  for (const auto& offset_serialized : *roots_file_) {
     const auto& serialized = offset_serialized.second;
     roots_.insert(Board::Deserialize(serialized.begin()));
   }
@@ -271,6 +457,7 @@ Book<version>::Book(const std::string& folder) : folder_(folder), value_files_()
 
 template<int version>
 void Book<version>::AddChildren(const Board& father_board, const std::vector<Node>& children) {
+  assert(!IsFrozen());
   Book<version>::BookNode* father = Mutable(father_board);
   assert(father);
   assert(father->IsLeaf());
@@ -307,6 +494,7 @@ void Book<version>::AddChildren(const Board& father_board, const std::vector<Nod
 
 template<int version>
 typename Book<version>::BookNode* Book<version>::Add(const TreeNode& node) {
+  assert(!IsFrozen());
   Board unique = node.ToBoard().Unique();
   roots_.insert(unique);
   return AddNoRootsUpdate(node);
@@ -315,7 +503,7 @@ typename Book<version>::BookNode* Book<version>::Add(const TreeNode& node) {
 template<int version>
 typename Book<version>::BookNode* Book<version>::AddNoRootsUpdate(const TreeNode& node) {
   Board unique = node.ToBoard().Unique();
-  assert(!Get(unique));
+  assert(modified_nodes_.find(unique) == modified_nodes_.end() && !GetFromFiles(unique));
   auto iterator_inserted = modified_nodes_.emplace(unique, std::make_unique<BookNode>(this, node));
   iterator_inserted.first->second->is_leaf_ = true;
   assert(iterator_inserted.second);
@@ -329,16 +517,38 @@ std::unique_ptr<Node> Book<version>::Get(const Board& b) const {
   if (iterator != modified_nodes_.end()) {
     return std::make_unique<Node>(*iterator->second);
   }
-  HashMapNode node = Find(unique.Player(), unique.Opponent()).second;
+  if (cache_->Capacity() == 0) {
+    return GetFromFiles(unique);
+  }
+  std::shared_ptr<const Node> node = cache_->GetOrCompute(unique, [&]() {
+    return std::shared_ptr<const Node>(GetFromFiles(unique));
+  });
+  return node == nullptr ? nullptr : std::make_unique<Node>(*node);
+}
+
+template<int version>
+std::unique_ptr<Node> Book<version>::GetFromFiles(const Board& unique) const {
+  if (IsFrozen()) {
+    ValueSpan serialized = frozen_->Find(unique);
+    if (serialized.data() == nullptr) {
+      return nullptr;
+    }
+    return std::make_unique<Node>(Node::Deserialize(serialized, version, nullptr));
+  }
+  if (!filter_.MayContain(HashFull(unique.Player(), unique.Opponent()))) {
+    return nullptr;
+  }
+  ValueSpan serialized;
+  HashMapNode node = Find(unique.Player(), unique.Opponent(), &serialized).second;
   if (!node.IsEmpty()) {
-    std::vector<char> serialized = GetValueFile(node).Get(node.Offset());
     return std::make_unique<Node>(Node::Deserialize(serialized, version, nullptr));
   }
   return nullptr;
 }
 
 template<int version>
-void Book<version>::Commit(bool verbose) {
+bool Book<version>::Commit(bool verbose) {
+  assert(!IsFrozen());
   // Logic taken from https://stackoverflow.com/questions/76798937.
 
 #if defined(__GNUC__) || defined(__GNUG__) || defined(clang)
@@ -346,27 +556,24 @@ void Book<version>::Commit(bool verbose) {
   signal(SIGHUP, this->HandleSignal);   // Close terminal
   signal(SIGQUIT, this->HandleSignal);  // CTRL-/
 #endif
+  ElapsedTime time;
   if (verbose) {
     std::cout << "Committing " << modified_nodes_.size() << " nodes: " << std::flush;
   }
-  roots_file_.Clean();
-  for (const Board& b : roots_) {
-    assert(b == b.Unique());
-    roots_file_.Add(b.Serialize());
-  }
-  for (const auto& board_node : modified_nodes_) {
-    if (verbose) {
-      std::cout << "." << std::flush;
+  bool success = WriteCommit();
+  cache_->Clear();
+  if (success) {
+    last_commit_size_ = modified_nodes_.size();
+    modified_nodes_.clear();
+    if (filter_.NKeys() > filter_.Capacity()) {
+      RebuildFilter();
+    } else {
+      SaveFilter();
     }
-    Commit(*board_node.second);
   }
-  modified_nodes_.clear();
-  auto file = IndexFile();
-  UpdateSizes(file);
-  assert(modified_nodes_.empty());
-  file.close();
-  if (verbose) {
-    std::cout << " Done\n" << std::flush;
+  last_commit_seconds_ = time.Get();
+  if (verbose && success) {
+    std::cout << "Done (" << last_commit_size_ / std::max(last_commit_seconds_, 1E-9) << " nodes/sec)\n" << std::flush;
   }
   // Reset these actions to default behavior.
 #if defined(__GNUC__) || defined(__GNUG__) || defined(clang)
@@ -377,44 +584,170 @@ void Book<version>::Commit(bool verbose) {
   if (received_signal_ != NSIG) {
     raise(received_signal_);
   }
-  assert(IsSizeOK());
+  assert(!success || IsSizeOK());
+  return success;
 }
 
 template<int version>
-void Book<version>::Commit(const BookNode& node) {
-  auto file_hash_map_node = Find(node.Player(), node.Opponent());
-  auto& file = file_hash_map_node.first;
-  auto& hash_map_node = file_hash_map_node.second;
-  Board b = node.ToBoard();
-
-  if (!hash_map_node.IsEmpty()) {
-    std::vector<char> removed = MutableValueFile(hash_map_node).Remove(hash_map_node.Offset());
-    std::unique_ptr<BookNode> removed_node = BookNode::Deserialize(this, removed);
-    assert(node.NFathers() >= removed_node->NFathers());
-    assert(b == removed_node->ToBoard());
-    assert ((roots_.find(b) != roots_.end()) == !node.HasFathers());
-  } else {
-    ++book_size_;
+bool Book<version>::WriteCommit() {
+  // The log of a commit that could not be applied must be applied first: the
+  // new log would replace it, but it is planned on the files as they are.
+  if (FileExists(CommitLogFilename())) {
+    RecoverCommit();
+    if (FileExists(CommitLogFilename())) {
+      return false;
+    }
+    roots_file_->Reload();
+    ReloadSizes();
+  }
+  HashMapIndex book_size = book_size_;
+  CommitLog log = PlanCommit();
+  if (!log.Save(CommitLogFilename())) {
+    std::cout << "Could not save " << CommitLogFilename() << ", not committing\n";
+    book_size_ = book_size;
+    LoadFilter();
+    return false;
   }
+  roots_file_->Reload();
+  // If applying fails, the log stays there, and the next commit (or open)
+  // applies it again.
+  if (!log.Apply()) {
+    std::cout << "Could not apply " << CommitLogFilename() << ", keeping it\n";
+    book_size_ = book_size;
+    LoadFilter();
+    return false;
+  }
+  remove(CommitLogFilename().c_str());
+  return true;
+}
 
-  std::vector<char> to_store = node.Serialize();
-  int size = (int) to_store.size();
-  int position = value_files_[HashMapNode::SizeToPosition((int) to_store.size())].Add(to_store);
-  HashMapNode to_be_stored(size, position);
-  if (file.tellg() < (int64_t) OffsetToFilePosition(hash_map_size_)) {
-    file.write((char*) &to_be_stored, sizeof(HashMapNode));
-    Resize(file, {});
-  } else {
-    Resize(file, {to_be_stored});
+template<int version>
+CommitLog Book<version>::PlanCommit() {
+  std::vector<std::pair<Board, const BookNode*>> nodes;
+  for (const auto& [board, node] : modified_nodes_) {
+    nodes.emplace_back(board, node.get());
   }
-  // So that the asserts below work.
-  file.close();
-  assert(Get(node.ToBoard()));
-  assert(!Find(node.Player(), node.Opponent()).second.IsEmpty());
+  // Finds the slot of each node, claiming distinct empty slots for the new
+  // ones. If the index is too small, it grows it and starts again.
+  std::vector<std::pair<HashMapIndex, HashMapNode>> slots(nodes.size());
+  while (true) {
+    std::vector<uint32_t> new_hashes;
+    for (int i = 0; i < nodes.size(); ++i) {
+      const Board& board = nodes[i].first;
+      slots[i] = Find(board.Player(), board.Opponent());
+      if (slots[i].second.IsEmpty()) {
+        new_hashes.push_back(HashFull(board.Player(), board.Opponent()));
+      }
+    }
+    if (book_size_ + new_hashes.size() > kMaxLoadFactor * hash_map_size_) {
+      Grow(new_hashes);
+      continue;
+    }
+    std::unordered_set<HashMapIndex> claimed;
+    bool overflow = false;
+    for (auto& [slot, hash_map_node] : slots) {
+      if (hash_map_node.IsEmpty()) {
+        while (slot < hash_map_size_ && (!IndexSlots()[slot].IsEmpty() || claimed.count(slot) > 0)) {
+          ++slot;
+        }
+        claimed.insert(slot);
+        overflow = overflow || slot == hash_map_size_;
+      }
+    }
+    if (!overflow) {
+      break;
+    }
+    Grow(new_hashes);
+  }
+
+  CommitLog log(CommitLogFiles());
+  // The empty elements and the size of each value file, as the commit goes.
+  // New values go in the empty elements on disk (or at the end); the values
+  // they replace become empty at the end of the commit.
+  struct ValueFilePlan {
+    BookFileOffset first_empty;
+    BookFileOffset elements;
+    bool changed;
+    std::vector<BookFileOffset> removed;
+  };
+  std::map<int, ValueFilePlan> value_file_plans;
+  auto get_plan = [&](int position) -> ValueFilePlan& {
+    auto iterator = value_file_plans.find(position);
+    if (iterator == value_file_plans.end()) {
+      const ValueFile& value_file = value_files_[position];
+      iterator = value_file_plans.emplace(
+          position, ValueFilePlan {value_file.FirstEmpty(), value_file.Elements(), false, {}}).first;
+    }
+    return iterator->second;
+  };
+
+  for (int i = 0; i < nodes.size(); ++i) {
+    const auto& [board, node] = nodes[i];
+    const auto& [slot, old_node] = slots[i];
+    std::vector<char> value = node->Serialize();
+    int size = (int) value.size();
+    int position = HashMapNode::SizeToPosition(size);
+    const ValueFile& value_file = value_files_[position];
+    ValueFilePlan& plan = get_plan(position);
+    BookFileOffset offset;
+    if (plan.first_empty != 0) {
+      offset = plan.first_empty;
+      plan.first_empty = value_file.NextEmpty(offset);
+      plan.changed = true;
+    } else {
+      offset = plan.elements++;
+    }
+    value.resize(value_file.Size(), 0);
+    log.Write(kFirstValueFile + position, offset * (uint64_t) value_file.Size(), value.data(), value.size());
+
+    HashMapNode hash_map_node(size, offset);
+    log.Write(kIndexFile, OffsetToFilePosition(slot), (const char*) &hash_map_node, sizeof(HashMapNode));
+    if (old_node.IsEmpty()) {
+      uint32_t hash = HashFull(board.Player(), board.Opponent());
+      log.Write(kHashesFile, HashOffsetToFilePosition(slot), (const char*) &hash, sizeof(hash));
+      filter_.Add(hash);
+      ++book_size_;
+    } else {
+      assert(BookNode::Deserialize(this, GetValueFile(old_node).View(old_node.Offset()))->ToBoard() == node->ToBoard());
+      assert(node->NFathers() >= BookNode::Deserialize(this, GetValueFile(old_node).View(old_node.Offset()))->NFathers());
+      assert((roots_.find(board) != roots_.end()) == !node->HasFathers());
+      get_plan(old_node.GetValueFilePosition()).removed.push_back(old_node.Offset());
+    }
+  }
+  for (auto& [position, plan] : value_file_plans) {
+    ValueFileSize size = value_files_[position].Size();
+    std::vector<char> empty(size, 0);
+    std::sort(plan.removed.begin(), plan.removed.end());
+    for (BookFileOffset offset : plan.removed) {
+      memcpy(empty.data(), &plan.first_empty, sizeof(BookFileOffset));
+      log.Write(kFirstValueFile + position, offset * (uint64_t) size, empty.data(), size);
+      plan.first_empty = offset;
+    }
+    if (plan.changed || !plan.removed.empty()) {
+      memcpy(empty.data(), &plan.first_empty, sizeof(BookFileOffset));
+      log.Write(kFirstValueFile + position, 0, empty.data(), size);
+    }
+  }
+  HashMapIndex sizes[] = {hash_map_size_, book_size_};
+  log.Write(kIndexFile, 0, (const char*) sizes, sizeof(sizes));
+  log.Write(kHashesFile, 0, (const char*) sizes, sizeof(sizes));
+
+  std::vector<char> roots(kSerializedBoardSize, 0);
+  for (const Board& b : roots_) {
+    assert(b == b.Unique());
+    SerializedBoard serialized = b.Serialize();
+    roots.insert(roots.end(), serialized.begin(), serialized.end());
+  }
+  log.Truncate(kRootsFile, roots.size());
+  log.Write(kRootsFile, 0, roots.data(), roots.size());
+  return log;
 }
 
 template<int version>
 bool Book<version>::IsSizeOK() {
+  if (IsFrozen()) {
+    return true;
+  }
   auto index_file = IndexFile();
   if (OffsetToFilePosition(hash_map_size_) != FileLength(index_file)) {
     std::cout << "Wrong hash map size " << OffsetToFilePosition(hash_map_size_) << ". Should be " << FileLength(index_file) << "\n";
@@ -458,19 +791,180 @@ void Book<version>::Print(int start, int end) {
 
 template<int version>
 void Book<version>::Clean() {
+  assert(!IsFrozen());
+  UnmapIndex();
   std::ofstream(IndexFilename(), std::ios::binary | std::ios::out).close();
+  std::ofstream(HashesFilename(), std::ios::binary | std::ios::out).close();
   for (ValueFile& value_file : value_files_) {
     value_file.Clean();
   }
-  roots_file_.Clean();
+  roots_file_->Clean();
   roots_.clear();
+  cache_->Clear();
   auto file = IndexFile();
+  auto hashes_file = HashesFile();
   hash_map_size_ = kInitialHashMapSize;
   book_size_ = 0;
   UpdateSizes(file);
+  UpdateSizes(hashes_file);
   std::vector<HashMapNode> nodes(kInitialHashMapSize);
   file.write((char*) &nodes[0], kInitialHashMapSize * sizeof(HashMapNode));
+  std::vector<uint32_t> hashes(kInitialHashMapSize, 0);
+  hashes_file.write((char*) &hashes[0], kInitialHashMapSize * sizeof(uint32_t));
+  file.close();
+  hashes_file.close();
   modified_nodes_.clear();
+  remove(CommitLogFilename().c_str());
+  MapIndex();
+  filter_.Reset(kInitialHashMapSize);
+  SaveFilter();
+}
+
+template<int version>
+template<class Visit>
+void Book<version>::Scan(Visit visit, int n_threads) const {
+  constexpr int kBatchSize = 16384;
+  n_threads = std::max(1, n_threads);
+  std::vector<std::future<void>> running(n_threads);
+  std::vector<ValueSpan> batch;
+  int next_thread = 0;
+  auto run_batch = [&]() {
+    std::future<void>& previous = running[next_thread];
+    if (previous.valid()) {
+      previous.get();
+    }
+    previous = std::async(std::launch::async, [&visit, batch = std::move(batch), thread = next_thread]() {
+      for (const ValueSpan& serialized : batch) {
+        Node node = Node::Deserialize(serialized, version, nullptr);
+        visit(node, thread);
+      }
+    });
+    batch.clear();
+    next_thread = (next_thread + 1) % n_threads;
+  };
+  auto add = [&](ValueSpan serialized) {
+    batch.push_back(serialized);
+    if (batch.size() == kBatchSize) {
+      run_batch();
+    }
+  };
+  auto finish = [&]() {
+    if (!batch.empty()) {
+      run_batch();
+    }
+    for (std::future<void>& future : running) {
+      if (future.valid()) {
+        future.get();
+      }
+    }
+  };
+
+  if (IsFrozen()) {
+    frozen_->ForEachRecord(add);
+    finish();
+    return;
+  }
+  for (const ValueFile& value_file : value_files_) {
+    // The spans point to the mapping of the iterator, which must outlive the
+    // batches.
+    ValueFile::Iterator iterator = value_file.begin();
+    for (ValueFile::Iterator end = value_file.end(); iterator != end; ++iterator) {
+      add(iterator->second);
+    }
+    finish();
+  }
+}
+
+template<int version>
+bool Book<version>::Freeze(const std::string& folder) const {
+  assert(!IsFrozen());
+  assert(modified_nodes_.empty());
+  std::error_code error;
+  if (fs::equivalent(folder, folder_, error) || FileExists(folder + "/index.sen")) {
+    std::cout << "Cannot freeze the book in " << folder << ", which contains a book\n";
+    return false;
+  }
+  int n_threads = std::max(1, (int) std::thread::hardware_concurrency());
+  std::vector<std::vector<std::vector<char>>> records_by_thread(n_threads);
+  Scan([&records_by_thread](Node& node, int thread) {
+    records_by_thread[thread].push_back(BookNode(nullptr, node).Serialize());
+  }, n_threads);
+  std::vector<std::vector<char>> records;
+  records.reserve(book_size_);
+  for (auto& thread_records : records_by_thread) {
+    std::move(thread_records.begin(), thread_records.end(), std::back_inserter(records));
+  }
+  assert(records.size() == book_size_);
+  CreateEmptyFileWithDirectories(FrozenBook::Filename(folder));
+  FrozenBook::Write(FrozenBook::Filename(folder), std::vector<Board>(roots_.begin(), roots_.end()), std::move(records));
+  return true;
+}
+
+template<int version>
+bool Book<version>::AreHashesOK() const {
+  std::fstream hashes_file(HashesFilename(), std::ios::binary | std::ios::in);
+  if (!hashes_file.is_open() ||
+      FileLength(hashes_file) != HashOffsetToFilePosition(hash_map_size_)) {
+    return false;
+  }
+  HashMapIndex hash_map_size;
+  HashMapIndex book_size;
+  hashes_file.seekg(0);
+  hashes_file.read((char*) &hash_map_size, sizeof(hash_map_size));
+  hashes_file.read((char*) &book_size, sizeof(book_size));
+  return hash_map_size == hash_map_size_ && book_size == book_size_;
+}
+
+// Recomputes the hashes of a book written before they existed (or after a
+// crash in the middle of a commit). The candidates are sorted by value file
+// and offset, so that each value file is read sequentially.
+template<int version>
+void Book<version>::RebuildHashes() {
+  std::vector<std::pair<HashMapNode, HashMapIndex>> nodes;
+  std::vector<uint32_t> hashes(hash_map_size_, 0);
+  {
+    MappedFile index_map(IndexFilename());
+    const HashMapNode* slots = (const HashMapNode*) (index_map.Data() + kOffset);
+    for (HashMapIndex slot = 0; slot < hash_map_size_; ++slot) {
+      if (!slots[slot].IsEmpty()) {
+        nodes.emplace_back(slots[slot], slot);
+      }
+    }
+  }
+  std::sort(nodes.begin(), nodes.end(), [](const auto& left, const auto& right) {
+    return std::make_pair(left.first.GetValueFilePosition(), left.first.Offset()) <
+           std::make_pair(right.first.GetValueFilePosition(), right.first.Offset());
+  });
+  for (const auto& [node, slot] : nodes) {
+    Board board = Board::Deserialize(GetValueFile(node).View(node.Offset()).begin());
+    hashes[slot] = HashFull(board.Player(), board.Opponent());
+  }
+  UnmapIndex();
+  std::fstream hashes_file(HashesFilename(), std::ios::binary | std::ios::out | std::ios::trunc);
+  UpdateSizes(hashes_file);
+  hashes_file.write((char*) hashes.data(), hashes.size() * sizeof(uint32_t));
+  hashes_file.close();
+  MapIndex();
+}
+
+template<int version>
+void Book<version>::LoadFilter() {
+  if (!filter_.Deserialize(ReadFile<char>(FilterFilename())) || filter_.NKeys() != book_size_) {
+    RebuildFilter();
+  }
+}
+
+template<int version>
+void Book<version>::RebuildFilter() {
+  filter_.Reset(std::max(2 * book_size_, kInitialHashMapSize));
+  const HashMapNode* slots = IndexSlots();
+  const uint32_t* hashes = HashSlots();
+  for (HashMapIndex slot = 0; slot < hash_map_size_; ++slot) {
+    if (!slots[slot].IsEmpty()) {
+      filter_.Add(hashes[slot]);
+    }
+  }
+  SaveFilter();
 }
 
 template<int version>
@@ -498,79 +992,114 @@ HashMapIndex Book<version>::RepositionHash(HashMapIndex board_hash) const {
 }
 
 template<int version>
-std::pair<std::fstream, HashMapNode> Book<version>::Find(BitPattern player, BitPattern opponent) const {
+std::pair<HashMapIndex, HashMapNode> Book<version>::Find(BitPattern player, BitPattern opponent, ValueSpan* serialized) const {
   Board unique = Board(player, opponent).Unique();
-  player = unique.Player();
-  opponent = unique.Opponent();
-  auto hash = RepositionHash(HashFull(player, opponent));
-  assert(std::fstream(IndexFilename(), std::ios::in | std::ios::binary).is_open());
-  auto file = IndexFile();
-  file.seekg(OffsetToFilePosition(hash));
-  HashMapNode node;
+  uint32_t board_hash = HashFull(unique.Player(), unique.Opponent());
+  SerializedBoard key = unique.Serialize();
+  const HashMapNode* nodes = IndexSlots();
+  const uint32_t* hashes = HashSlots();
 
-  while (true) {
-    file.read((char*) &node, sizeof(HashMapNode));
+  for (HashMapIndex slot = RepositionHash(board_hash); slot < hash_map_size_; ++slot) {
+    HashMapNode node = nodes[slot];
     if (node.IsEmpty()) {
-      file.seekg((unsigned long long) file.tellg() - sizeof(HashMapNode));
-      file.seekp(file.tellg());
-      return std::make_pair(std::move(file), node);
+      return std::make_pair(slot, node);
     }
-    std::vector<char> v = GetValueFile(node).Get(node.Offset());
-    Board b = Board::Deserialize(v.begin());
-    assert(b == b.Unique());
-    if (b.Player() == player && b.Opponent() == opponent) {
-      file.seekg((unsigned) file.tellg() - sizeof(HashMapNode));
-      file.seekp(file.tellg());
-      return std::make_pair(std::move(file), node);
+    if (hashes[slot] != board_hash) {
+      continue;
     }
-
-    if (file.tellg() == OffsetToFilePosition(hash_map_size_)) {
-      file.seekp(file.tellg());
-      return std::make_pair(std::move(file), HashMapNode());
+    // Same hash: compare the serialized boards, without deserializing.
+    ValueSpan v = GetValueFile(node).View(node.Offset());
+    if (memcmp(v.data(), key.data(), kSerializedBoardSize) == 0) {
+      if (serialized != nullptr) {
+        *serialized = v;
+      }
+      return std::make_pair(slot, node);
     }
   }
+  return std::make_pair(hash_map_size_, HashMapNode());
 }
 
+// Reads the old index sequentially, sorts the elements by their new slot, and
+// writes the new index and hashes sequentially to temporary files, which then
+// replace the old ones. The board hashes come from the hashes file, so the
+// value files are not read.
+// A crash before the renames leaves the old index. A crash between them leaves
+// the hashes with a different size than the index, and they are rebuilt on the
+// next open.
 template<int version>
-void Book<version>::Resize(std::fstream& file, std::vector<HashMapNode> add_elements) {
-  HashMapNode node_to_move;
-  HashMapNode empty_node;
-
-  int extra_buffer = (int) add_elements.size();
-  while (book_size_ > 0.4 * hash_map_size_ || extra_buffer > 0) {
-    int current_buffer = 0;
-    for (HashMapIndex invalidated = RepositionHash(hash_map_size_); true; ++invalidated) {
-      file.seekg(OffsetToFilePosition(invalidated));
-      file.read((char*) &node_to_move, sizeof(node_to_move));
-      file.seekp(OffsetToFilePosition(invalidated));
-      file.write((char*) &empty_node, sizeof(empty_node));
-      if (node_to_move.IsEmpty()) {
-        break;
-      }
-      add_elements.push_back(node_to_move);
-      ++current_buffer;
+void Book<version>::Rehash(HashMapIndex size, const std::vector<uint32_t>& new_hashes) {
+  struct Element {
+    HashMapIndex slot;
+    HashMapNode node;
+    uint32_t hash;
+  };
+  std::vector<Element> elements;
+  elements.reserve(book_size_);
+  const HashMapNode* slots = IndexSlots();
+  const uint32_t* hashes = HashSlots();
+  for (HashMapIndex slot = 0; slot < hash_map_size_; ++slot) {
+    if (!slots[slot].IsEmpty()) {
+      elements.push_back(Element {0, slots[slot], hashes[slot]});
     }
-    extra_buffer = std::max(current_buffer, extra_buffer);
-    file.seekp(0, std::ios::end);
-    file.write((char*) &empty_node, sizeof(empty_node));
-    ++hash_map_size_;
-    --extra_buffer;
+  }
+  assert(elements.size() == book_size_);
+  UnmapIndex();
+  // Placeholders for the new boards (the slots used by linear probing do not
+  // depend on the order of insertion, so they will fit).
+  for (uint32_t hash : new_hashes) {
+    elements.push_back(Element {0, HashMapNode(), hash});
   }
 
-  for (const HashMapNode& add_element : add_elements) {
-    std::vector<char> v = GetValueFile(add_element).Get(add_element.Offset());
-    Board board = Board::Deserialize(v.begin());
-    HashMapIndex hash = RepositionHash(HashFull(board.Player(), board.Opponent()));
-    HashMapNode board_in_position;
-    file.seekg(OffsetToFilePosition(hash));
-    file.read((char*) &board_in_position, sizeof(board_in_position));
-    while (!board_in_position.IsEmpty()) {
-      file.read((char*) &board_in_position, sizeof(board_in_position));
+  // Linear probing: in order of first slot, each element goes in its first
+  // slot, or right after the previous element. If the last elements do not
+  // fit, it tries again with more slots.
+  while (true) {
+    hash_map_size_ = size;
+    for (Element& element : elements) {
+      element.slot = RepositionHash(element.hash);
+    }
+    std::sort(elements.begin(), elements.end(), [](const Element& left, const Element& right) {
+      return left.slot < right.slot;
+    });
+    HashMapIndex next_free = 0;
+    for (Element& element : elements) {
+      element.slot = std::max(element.slot, next_free);
+      next_free = element.slot + 1;
+    }
+    if (next_free <= size) {
+      break;
     }
-    file.seekp((uint64_t) file.tellg() - sizeof(HashMapNode));
-    file.write((char*) &add_element, sizeof(add_element));
+    size = next_free;
   }
-  UpdateSizes(file);
+
+  std::string index_filename = IndexFilename() + ".tmp";
+  std::string hashes_filename = HashesFilename() + ".tmp";
+  {
+    std::fstream file(index_filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    std::fstream hashes_file(hashes_filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    UpdateSizes(file);
+    UpdateSizes(hashes_file);
+    constexpr HashMapIndex kChunkSize = 1 << 16;
+    std::vector<HashMapNode> chunk_nodes;
+    std::vector<uint32_t> chunk_hashes;
+    auto element = elements.begin();
+    for (HashMapIndex start = 0; start < hash_map_size_; start += kChunkSize) {
+      HashMapIndex end = std::min(start + kChunkSize, hash_map_size_);
+      chunk_nodes.assign(end - start, HashMapNode());
+      chunk_hashes.assign(end - start, 0);
+      for (; element != elements.end() && element->slot < end; ++element) {
+        if (!element->node.IsEmpty()) {
+          chunk_nodes[element->slot - start] = element->node;
+          chunk_hashes[element->slot - start] = element->hash;
+        }
+      }
+      file.write((char*) chunk_nodes.data(), chunk_nodes.size() * sizeof(HashMapNode));
+      hashes_file.write((char*) chunk_hashes.data(), chunk_hashes.size() * sizeof(uint32_t));
+    }
+  }
+  fs::rename(hashes_filename, HashesFilename());
+  fs::rename(index_filename, IndexFilename());
+  MapIndex();
 }
 
 #endif //OTHELLOSENSEI_POSITION_TO_DATA_H
@@ -170,6 +170,281 @@ TEST(Book, LargeOne) {
   }
 }
 
+TEST(Book, RebuildHashes) {
+  std::vector<Board> boards;
+  {
+    Book<> book(kTempDir);
+    book.Clean();
+    for (int i = 0; i < 200; ++i) {
+      Board b = RandomBoard();
+      if (!book.Get(b)) {
+        book.Add(*TestTreeNode(b, 0, -63, 63, 10));
+        boards.push_back(b);
+      }
+    }
+    book.Commit();
+  }
+  remove((kTempDir + "/hashes.sen").c_str());
+
+  Book<> book(kTempDir);
+  EXPECT_TRUE(book.IsSizeOK());
+  for (const Board& b : boards) {
+    ASSERT_TRUE(book.Get(b));
+  }
+  EXPECT_FALSE(book.Get(Board(0UL, 1UL)));
+}
+
+TEST(Book, Filter) {
+  std::vector<Board> boards;
+  {
+    Book<> book(kTempDir);
+    book.Clean();
+    // Several commits, so that the filter grows.
+    for (int i = 0; i < 10; ++i) {
+      for (int j = 0; j < 20; ++j) {
+        Board b = RandomBoard();
+        if (!book.Get(b)) {
+          book.Add(*TestTreeNode(b, 0, -63, 63, 10));
+          boards.push_back(b);
+        }
+      }
+      book.Commit();
+    }
+  }
+  for (bool remove_filter : {false, true}) {
+    if (remove_filter) {
+      remove((kTempDir + "/index_filter.sen").c_str());
+    }
+    Book<> book(kTempDir);
+    for (const Board& b : boards) {
+      ASSERT_TRUE(book.Get(b));
+    }
+    EXPECT_FALSE(book.Get(Board(0UL, 1UL)));
+  }
+}
+
+TEST(Book, GrowInOneCommit) {
+  std::vector<Board> boards;
+  Book<> book(kTempDir);
+  book.Clean();
+  for (int i = 0; i < 2000; ++i) {
+    Board b = RandomBoard();
+    if (!book.Get(b)) {
+      book.Add(*TestTreeNode(b, 0, -63, 63, 10));
+      boards.push_back(b);
+    }
+  }
+  book.Commit();
+  EXPECT_TRUE(book.IsSizeOK());
+  EXPECT_EQ(book.Size(), boards.size());
+  EXPECT_FALSE(FileExists(kTempDir + "/index.sen.tmp"));
+  EXPECT_FALSE(FileExists(kTempDir + "/hashes.sen.tmp"));
+
+  Book<> reopened(kTempDir);
+  for (const Board& b : boards) {
+    ASSERT_TRUE(reopened.Get(b));
+  }
+}
+
+TEST(Book, IncompleteCommitLog) {
+  TestBook test_book;
+  {
+    Book<> book(kTempDir);
+    book.Clean();
+    book.Add(*TestTreeNode(Board(0UL, 1UL), 0, -5, 5, 10));
+    book.Commit();
+    EXPECT_EQ(book.LastCommitSize(), 1);
+  }
+  EXPECT_FALSE(FileExists(kTempDir + "/commit_log.sen"));
+  // A log without its trailer, as if the process died while saving it: the
+  // book files were not touched yet, so the book is unchanged.
+  std::ofstream(kTempDir + "/commit_log.sen", std::ios::binary) << "SNSICML1 partial";
+
+  Book<> book(kTempDir);
+  EXPECT_FALSE(FileExists(kTempDir + "/commit_log.sen"));
+  EXPECT_TRUE(book.IsSizeOK());
+  EXPECT_EQ(book.Size(), 1);
+  EXPECT_EQ(*book.Get(0, 1), *GetTestBookTreeNode(&test_book, Board(0UL, 1UL), 0, -5, 5, 10));
+  EXPECT_EQ(book.Roots(), std::unordered_set<Board>({Board(0UL, 1UL)}));
+}
+
+TEST(Book, CompleteCommitLog) {
+  TestBook test_book;
+  {
+    Book<> book(kTempDir);
+    book.Clean();
+    book.Add(*TestTreeNode(Board(0UL, 1UL), 0, -5, 5, 10));
+    book.Commit();
+    book.Add(*TestTreeNode(Board(0UL, 2UL), 0, -7, 7, 10));
+    // Applying the log fails in the middle, as if the process died after
+    // saving it: the log stays there.
+    fs::rename(kTempDir + "/hashes.sen", kTempDir + "/hashes.sen.bak");
+    book.Commit();
+    fs::rename(kTempDir + "/hashes.sen.bak", kTempDir + "/hashes.sen");
+  }
+  EXPECT_TRUE(FileExists(kTempDir + "/commit_log.sen"));
+
+  // Opening the book applies the log again.
+  Book<> book(kTempDir);
+  EXPECT_FALSE(FileExists(kTempDir + "/commit_log.sen"));
+  EXPECT_TRUE(book.IsSizeOK());
+  EXPECT_EQ(book.Size(), 2);
+  EXPECT_EQ(*book.Get(0, 1), *GetTestBookTreeNode(&test_book, Board(0UL, 1UL), 0, -5, 5, 10));
+  EXPECT_EQ(*book.Get(0, 2), *GetTestBookTreeNode(&test_book, Board(0UL, 2UL), 0, -7, 7, 10));
+  EXPECT_EQ(book.Roots(), std::unordered_set<Board>({Board(0UL, 1UL), Board(0UL, 2UL)}));
+}
+
+TEST(Book, CommitSaveFails) {
+  TestBook test_book;
+  Book<> book(kTempDir);
+  book.Clean();
+  book.Add(*TestTreeNode(Board(0UL, 1UL), 0, -5, 5, 10));
+  EXPECT_TRUE(book.Commit());
+  book.Add(*TestTreeNode(Board(0UL, 2UL), 0, -7, 7, 10));
+  // The log cannot be written (it links to a missing directory): the commit
+  // does not touch the book.
+  fs::create_symlink(kTempDir + "/missing_dir/commit_log.sen", kTempDir + "/commit_log.sen");
+  EXPECT_FALSE(book.Commit());
+  EXPECT_EQ(book.Size(), 1);
+  EXPECT_EQ(*book.Get(0, 2), *GetTestBookTreeNode(&test_book, Board(0UL, 2UL), 0, -7, 7, 10));
+  fs::remove(kTempDir + "/commit_log.sen");
+  EXPECT_EQ(Book<>(kTempDir).Size(), 1);
+
+  EXPECT_TRUE(book.Commit());
+  EXPECT_EQ(book.Size(), 2);
+  Book<> reopened(kTempDir);
+  EXPECT_TRUE(reopened.IsSizeOK());
+  EXPECT_EQ(*reopened.Get(0, 1), *GetTestBookTreeNode(&test_book, Board(0UL, 1UL), 0, -5, 5, 10));
+  EXPECT_EQ(*reopened.Get(0, 2), *GetTestBookTreeNode(&test_book, Board(0UL, 2UL), 0, -7, 7, 10));
+}
+
+TEST(Book, CommitApplyFails) {
+  TestBook test_book;
+  Book<> book(kTempDir);
+  book.Clean();
+  book.Add(*TestTreeNode(Board(0UL, 1UL), 0, -5, 5, 10));
+  EXPECT_TRUE(book.Commit());
+  book.Add(*TestTreeNode(Board(0UL, 2UL), 0, -7, 7, 10));
+  fs::rename(kTempDir + "/hashes.sen", kTempDir + "/hashes.sen.bak");
+  EXPECT_FALSE(book.Commit());
+  fs::rename(kTempDir + "/hashes.sen.bak", kTempDir + "/hashes.sen");
+  EXPECT_TRUE(FileExists(kTempDir + "/commit_log.sen"));
+  EXPECT_EQ(book.Size(), 1);
+
+  // The next commit applies the log first.
+  book.Add(*TestTreeNode(Board(0UL, 3UL), 0, -9, 9, 10));
+  EXPECT_TRUE(book.Commit());
+  EXPECT_FALSE(FileExists(kTempDir + "/commit_log.sen"));
+  EXPECT_EQ(book.Size(), 3);
+  EXPECT_TRUE(book.IsSizeOK());
+  Book<> reopened(kTempDir);
+  EXPECT_EQ(reopened.Size(), 3);
+  EXPECT_EQ(*reopened.Get(0, 2), *GetTestBookTreeNode(&test_book, Board(0UL, 2UL), 0, -7, 7, 10));
+  EXPECT_EQ(*reopened.Get(0, 3), *GetTestBookTreeNode(&test_book, Board(0UL, 3UL), 0, -9, 9, 10));
+  EXPECT_EQ(reopened.Roots(), std::unordered_set<Board>({Board(0UL, 1UL), Board(0UL, 2UL), Board(0UL, 3UL)}));
+}
+
+TEST(Book, Freeze) {
+  const std::string frozen_dir = kTempDir + "_frozen";
+  std::vector<Board> boards;
+  Book<> book(kTempDir);
+  book.Clean();
+  // Children with fathers, and random nodes (that are also roots).
+  auto e6 = book.Add(*TestTreeNode(Board("e6"), 0, -63, 63, 10));
+  auto leaf = LeafToUpdate<BookNode>::Leaf({e6});
+  book.AddChildren(Board("e6"), {
+      *TestTreeNode(Board("e6f4"), 30, -63, 63, 10),
+      *TestTreeNode(Board("e6f6"), 30, -63, 63, 10),
+      *TestTreeNode(Board("e6d6"), 10, -63, 63, 10)});
+  leaf.Finalize(30);
+  for (int i = 0; i < 500; ++i) {
+    Board b = RandomBoard();
+    if (!book.Get(b)) {
+      book.Add(*TestTreeNode(b, i % 20 - 10, -63, 63, i + 1));
+      boards.push_back(b);
+    }
+  }
+  book.Commit();
+  for (const std::string& line : {"e6", "e6f4", "e6f6", "e6d6"}) {
+    boards.push_back(Board(line));
+  }
+  book.Freeze(frozen_dir);
+
+  Book<> frozen(frozen_dir);
+  EXPECT_TRUE(frozen.IsFrozen());
+  EXPECT_EQ(frozen.Size(), book.Size());
+  EXPECT_EQ(frozen.Roots(), book.Roots());
+  for (const Board& b : boards) {
+    ASSERT_EQ(*frozen.Get(b), *book.Get(b));
+  }
+  EXPECT_FALSE(frozen.Get(Board(0UL, 1UL)));
+
+  // The frozen book cannot go in a folder with a book.
+  EXPECT_FALSE(book.Freeze(kTempDir));
+  EXPECT_FALSE(FileExists(FrozenBook::Filename(kTempDir)));
+  fs::copy_file(FrozenBook::Filename(frozen_dir), FrozenBook::Filename(kTempDir));
+  EXPECT_THROW(Book<> both(kTempDir), std::invalid_argument);
+  fs::remove(FrozenBook::Filename(kTempDir));
+}
+
+TEST(Book, Scan) {
+  const std::string frozen_dir = kTempDir + "_frozen";
+  std::unordered_set<Board> boards;
+  Book<> book(kTempDir);
+  book.Clean();
+  for (int i = 0; i < 2000; ++i) {
+    Board b = RandomBoard();
+    if (!book.Get(b)) {
+      book.Add(*TestTreeNode(b, i % 20 - 10, -63, 63, i + 1));
+      boards.insert(b.Unique());
+    }
+  }
+  book.Commit();
+  book.Freeze(frozen_dir);
+  Book<> frozen(frozen_dir);
+
+  for (const Book<>* scanned : {&book, &frozen}) {
+    // With 0 threads, it scans with 1 thread.
+    for (int n_threads : {0, 1, 3}) {
+      std::vector<std::vector<Node>> nodes(std::max(1, n_threads));
+      scanned->Scan([&nodes](Node& node, int thread) {
+        nodes[thread].push_back(node);
+      }, n_threads);
+      std::unordered_set<Board> scanned_boards;
+      for (const std::vector<Node>& thread_nodes : nodes) {
+        for (const Node& node : thread_nodes) {
+          EXPECT_EQ(node, *book.Get(node.ToBoard()));
+          EXPECT_TRUE(scanned_boards.insert(node.ToBoard().Unique()).second);
+        }
+      }
+      EXPECT_EQ(scanned_boards, boards);
+    }
+  }
+}
+
+TEST(Book, Cache) {
+  TestBook test_book;
+  Book<> book(kTempDir);
+  book.Clean();
+  book.SetCacheCapacity(10);
+  book.Add(*TestTreeNode(Board(0UL, 1UL), 0, -5, 5, 1010));
+  book.Commit();
+
+  EXPECT_EQ(*book.Get(0, 1), *GetTestBookTreeNode(&test_book, Board(0UL, 1UL), 0, -5, 5, 1010));
+  EXPECT_EQ(*book.Get(0, 1), *GetTestBookTreeNode(&test_book, Board(0UL, 1UL), 0, -5, 5, 1010));
+  EXPECT_FALSE(book.Get(0, 2));
+  EXPECT_FALSE(book.Get(0, 2));
+  EXPECT_EQ(book.CacheHits(), 2);
+  EXPECT_EQ(book.CacheMisses(), 2);
+
+  // The commit invalidates the cache.
+  book.Add(*TestTreeNode(Board(0UL, 2UL), 3, -5, 5, 10));
+  book.Mutable(Board(0UL, 1UL))->AddDescendants(5);
+  book.Commit();
+  EXPECT_EQ(book.Get(0, 1)->GetNVisited(), 1015);
+  EXPECT_TRUE(book.Get(0, 2));
+}
+
 TEST(Book, AddChildren) {
   TestBook test_book;
   Book<> book(kTempDir);
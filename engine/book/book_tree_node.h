@@ -50,7 +50,8 @@ class BookTreeNode : public TreeNode {
     CopyAndEnlargeToAllEvals(node);
   }
 
-  static std::unique_ptr<BookTreeNode> Deserialize(Book* book, const std::vector<char>& serialized) {
+  template<class Serialized>
+  static std::unique_ptr<BookTreeNode> Deserialize(Book* book, const Serialized& serialized) {
     std::vector<CompressedFlip> father_flips;
     Node n = Node::Deserialize(serialized, version, &father_flips);
     auto result = std::make_unique<BookTreeNode>(book, n);
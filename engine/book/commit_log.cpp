@@ -0,0 +1,177 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#include "commit_log.h"
+
+#include "../utils/files.h"
+
+namespace {
+
+constexpr uint64_t kMagic = 0x314C4D4349534E53ULL;  // "SNSICML1"
+
+// FNV-1a.
+uint64_t Checksum(const char* data, size_t size) {
+  uint64_t result = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < size; ++i) {
+    result = (result ^ (uint8_t) data[i]) * 0x100000001B3ULL;
+  }
+  return result;
+}
+
+template<typename T>
+void AppendValue(std::vector<char>* result, T value) {
+  result->insert(result->end(), (const char*) &value, (const char*) &value + sizeof(T));
+}
+
+template<typename T>
+const char* ReadValue(const char* data, T* value) {
+  memcpy(value, data, sizeof(T));
+  return data + sizeof(T);
+}
+
+}  // namespace
+
+void CommitLog::Write(int file, uint64_t position, const char* data, size_t size) {
+  assert(file >= 0 && file < filenames_.size());
+  records_.push_back(Record {(uint32_t) file, false, position, std::vector<char>(data, data + size)});
+}
+
+void CommitLog::Truncate(int file, uint64_t length) {
+  assert(file >= 0 && file < filenames_.size());
+  records_.push_back(Record {(uint32_t) file, true, length, {}});
+}
+
+// Format: magic, number of files, records (file, truncate, position, size,
+// data), number of records, checksum of everything before it.
+bool CommitLog::Save(const std::string& filename) const {
+  std::vector<char> serialized;
+  AppendValue(&serialized, kMagic);
+  AppendValue(&serialized, (uint32_t) filenames_.size());
+  for (const Record& record : records_) {
+    AppendValue(&serialized, record.file);
+    AppendValue(&serialized, (uint8_t) record.truncate);
+    AppendValue(&serialized, record.position);
+    AppendValue(&serialized, (uint64_t) record.data.size());
+    serialized.insert(serialized.end(), record.data.begin(), record.data.end());
+  }
+  AppendValue(&serialized, (uint64_t) records_.size());
+  AppendValue(&serialized, Checksum(serialized.data(), serialized.size()));
+  // The log must be on disk before the files are touched.
+  return WriteFileSynced(filename, serialized.data(), serialized.size());
+}
+
+bool CommitLog::Load(const std::string& filename) {
+  records_.clear();
+  std::vector<char> serialized = ReadFile<char>(filename);
+  constexpr size_t kHeaderSize = sizeof(uint64_t) + sizeof(uint32_t);
+  constexpr size_t kTrailerSize = 2 * sizeof(uint64_t);
+  if (serialized.size() < kHeaderSize + kTrailerSize) {
+    return false;
+  }
+  const char* trailer = serialized.data() + serialized.size() - kTrailerSize;
+  uint64_t magic;
+  uint32_t n_files;
+  uint64_t n_records;
+  uint64_t checksum;
+  ReadValue(ReadValue(trailer, &n_records), &checksum);
+  const char* data = ReadValue(ReadValue(serialized.data(), &magic), &n_files);
+  if (magic != kMagic || n_files != filenames_.size() ||
+      checksum != Checksum(serialized.data(), serialized.size() - sizeof(uint64_t))) {
+    return false;
+  }
+  while (data < trailer) {
+    Record record;
+    uint8_t truncate;
+    uint64_t size;
+    data = ReadValue(data, &record.file);
+    data = ReadValue(data, &truncate);
+    data = ReadValue(data, &record.position);
+    data = ReadValue(data, &size);
+    record.truncate = truncate != 0;
+    record.data.assign(data, data + size);
+    data += size;
+    records_.push_back(std::move(record));
+  }
+  if (data != trailer || records_.size() != n_records) {
+    records_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool CommitLog::Apply() const {
+  std::vector<std::vector<const Record*>> writes(filenames_.size());
+  std::vector<bool> changed(filenames_.size(), false);
+  for (const Record& record : records_) {
+    changed[record.file] = true;
+    if (record.truncate) {
+      std::error_code error;
+      fs::resize_file(filenames_[record.file], record.position, error);
+      if (error) {
+        return false;
+      }
+    } else {
+      writes[record.file].push_back(&record);
+    }
+  }
+  for (int i = 0; i < filenames_.size(); ++i) {
+    if (writes[i].empty()) {
+      continue;
+    }
+    std::stable_sort(writes[i].begin(), writes[i].end(), [](const Record* left, const Record* right) {
+      return left->position < right->position;
+    });
+    std::fstream file(filenames_[i], std::ios::binary | std::ios::out | std::ios::in);
+    if (!file.is_open()) {
+      return false;
+    }
+    for (auto record = writes[i].begin(); record != writes[i].end();) {
+      // The records that overlap or touch [start, end) are merged in one write.
+      uint64_t start = (*record)->position;
+      uint64_t end = start + (*record)->data.size();
+      auto group_end = std::next(record);
+      for (; group_end != writes[i].end() && (*group_end)->position <= end; ++group_end) {
+        end = std::max(end, (*group_end)->position + (*group_end)->data.size());
+      }
+      // Records are in records_, so their addresses follow the log order.
+      std::vector<const Record*> group(record, group_end);
+      std::sort(group.begin(), group.end());
+      std::vector<char> merged(end - start);
+      for (const Record* r : group) {
+        std::copy(r->data.begin(), r->data.end(), merged.begin() + (r->position - start));
+      }
+      file.seekp(start);
+      file.write(merged.data(), merged.size());
+      record = group_end;
+    }
+    file.flush();
+    if (!file) {
+      return false;
+    }
+  }
+  // The files must be on disk before the log is removed.
+  for (int i = 0; i < filenames_.size(); ++i) {
+    if (changed[i] && !SyncFile(filenames_[i])) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OTHELLOSENSEI_COMMIT_LOG_H
+#define OTHELLOSENSEI_COMMIT_LOG_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A redo log with the writes of a commit, addressed by file index and byte
+// position.
+//
+// A commit first saves the log, and only then applies it to the files. If the
+// process dies while saving, the log has no valid trailer, and the files are
+// untouched. If it dies while applying, the log is complete, and applying it
+// again on the next open finishes the commit: all writes are absolute, so
+// applying them twice is harmless.
+class CommitLog {
+ public:
+  explicit CommitLog(std::vector<std::string> filenames) : filenames_(std::move(filenames)) {}
+
+  // Writes size bytes of data in file at position.
+  void Write(int file, uint64_t position, const char* data, size_t size);
+
+  // Sets the length of file, before the writes in the same file.
+  void Truncate(int file, uint64_t length);
+
+  size_t NRecords() const { return records_.size(); }
+
+  // Writes the log and syncs it to disk. Returns false on failure.
+  bool Save(const std::string& filename) const;
+
+  // Returns false (and leaves the log empty) if the file is missing or
+  // incomplete.
+  bool Load(const std::string& filename);
+
+  // Applies the records to the files. The writes in each file are sorted by
+  // position, and contiguous writes are merged; where writes overlap, the
+  // last one in the log wins, and the files are synced to disk. Returns false
+  // if a file cannot be opened, resized, written or synced (the log can be
+  // applied again later).
+  bool Apply() const;
+
+ private:
+  struct Record {
+    uint32_t file;
+    bool truncate;
+    uint64_t position;
+    std::vector<char> data;
+  };
+  std::vector<std::string> filenames_;
+  std::vector<Record> records_;
+};
+
+#endif  // OTHELLOSENSEI_COMMIT_LOG_H
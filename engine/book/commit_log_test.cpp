@@ -0,0 +1,100 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include "../utils/files.h"
+#include "commit_log.h"
+
+const std::string kTempDir = "app/testdata/tmp/commit_log_test";
+const std::string kLogFile = kTempDir + "/commit_log.sen";
+const std::vector<std::string> kFiles = {kTempDir + "/file0", kTempDir + "/file1"};
+
+void WriteTestFile(const std::string& filename, const std::string& content) {
+  CreateEmptyFileWithDirectories(filename);
+  std::ofstream(filename, std::ios::binary) << content;
+}
+
+std::string ReadTestFile(const std::string& filename) {
+  std::vector<char> content = ReadFile<char>(filename);
+  return std::string(content.begin(), content.end());
+}
+
+TEST(CommitLog, SaveLoadApply) {
+  WriteTestFile(kFiles[0], "0123456789");
+  WriteTestFile(kFiles[1], "abcdef");
+  {
+    CommitLog log(kFiles);
+    log.Write(0, 4, "xy", 2);
+    log.Write(0, 2, "zw", 2);
+    log.Write(0, 9, "end", 3);
+    log.Truncate(1, 3);
+    log.Write(1, 1, "B", 1);
+    log.Save(kLogFile);
+  }
+  CommitLog log(kFiles);
+  ASSERT_TRUE(log.Load(kLogFile));
+  EXPECT_EQ(log.NRecords(), 5);
+  log.Apply();
+  EXPECT_EQ(ReadTestFile(kFiles[0]), "01zwxy678end");
+  EXPECT_EQ(ReadTestFile(kFiles[1]), "aBc");
+
+  // Applying it again does not change anything.
+  log.Apply();
+  EXPECT_EQ(ReadTestFile(kFiles[0]), "01zwxy678end");
+  EXPECT_EQ(ReadTestFile(kFiles[1]), "aBc");
+}
+
+TEST(CommitLog, IncompleteLog) {
+  CommitLog log(kFiles);
+  log.Write(0, 0, "abc", 3);
+  log.Save(kLogFile);
+  std::string saved = ReadTestFile(kLogFile);
+
+  for (int length : {0, 5, (int) saved.size() - 1}) {
+    WriteTestFile(kLogFile, saved.substr(0, length));
+    CommitLog loaded(kFiles);
+    EXPECT_FALSE(loaded.Load(kLogFile));
+    EXPECT_EQ(loaded.NRecords(), 0);
+  }
+  saved[saved.size() / 2] ^= 1;
+  WriteTestFile(kLogFile, saved);
+  EXPECT_FALSE(CommitLog(kFiles).Load(kLogFile));
+  EXPECT_FALSE(CommitLog(kFiles).Load(kTempDir + "/missing"));
+}
+
+TEST(CommitLog, OverlappingWrites) {
+  WriteTestFile(kFiles[0], "0123456789");
+  WriteTestFile(kFiles[1], "abcdef");
+  CommitLog log(kFiles);
+  log.Write(0, 2, "aaaa", 4);
+  log.Write(0, 1, "bb", 2);
+  log.Write(0, 4, "cc", 2);
+  log.Write(0, 3, "d", 1);
+  EXPECT_TRUE(log.Apply());
+  // The last write wins.
+  EXPECT_EQ(ReadTestFile(kFiles[0]), "0bbdcc6789");
+}
+
+TEST(CommitLog, ApplyFails) {
+  WriteTestFile(kFiles[0], "0123456789");
+  fs::remove(kFiles[1]);
+  CommitLog log(kFiles);
+  log.Write(1, 0, "abc", 3);
+  EXPECT_FALSE(log.Apply());
+  CommitLog truncate(kFiles);
+  truncate.Truncate(1, 3);
+  EXPECT_FALSE(truncate.Apply());
+  EXPECT_FALSE(log.Save(kTempDir + "/missing_dir/commit_log.sen"));
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#include "frozen_book.h"
+
+namespace {
+
+constexpr uint64_t kMagic = 0x315A524649534E53ULL;  // "SNSIFRZ1"
+// Average number of records in a bucket.
+constexpr uint64_t kRecordsPerBucket = 4;
+
+void AppendVarint(std::vector<char>* result, uint64_t value) {
+  while (value >= 128) {
+    result->push_back((char) (value & 127 | 128));
+    value >>= 7;
+  }
+  result->push_back((char) value);
+}
+
+const char* ReadVarint(const char* data, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; ; shift += 7) {
+    uint8_t byte = (uint8_t) *data++;
+    *value |= (uint64_t) (byte & 127) << shift;
+    if ((byte & 128) == 0) {
+      return data;
+    }
+  }
+}
+
+uint32_t RecordHash(const std::vector<char>& record) {
+  Board b = Board::Deserialize(record.begin());
+  return HashFull(b.Player(), b.Opponent());
+}
+
+}  // namespace
+
+FrozenBook::FrozenBook(const std::string& filename) : map_(std::make_unique<MappedFile>(filename)) {
+  const char* data = map_->Data();
+  uint64_t size = map_->Size();
+  uint64_t magic = 0;
+  uint32_t n_roots;
+  if (size >= kHeaderSize) {
+    memcpy(&magic, data, sizeof(uint64_t));
+    memcpy(&n_records_, data + 8, sizeof(uint64_t));
+    memcpy(&n_roots, data + 16, sizeof(uint32_t));
+    memcpy(&bucket_bits_, data + 20, sizeof(uint32_t));
+  }
+  if (magic != kMagic || bucket_bits_ > 32) {
+    throw std::invalid_argument(filename + " is not a frozen book");
+  }
+  uint64_t n_buckets = 1ULL << bucket_bits_;
+  uint64_t records_start = kHeaderSize + (n_buckets + 1) * sizeof(uint64_t) + (uint64_t) n_roots * kSerializedBoardSize;
+  if (records_start > size) {
+    throw std::invalid_argument(filename + ": truncated directory or roots");
+  }
+  directory_ = (const uint64_t*) (data + kHeaderSize);
+  // Each bucket ends where the next one starts, and the last one in the file.
+  for (uint64_t bucket = 0; bucket < n_buckets; ++bucket) {
+    if (directory_[bucket] > directory_[bucket + 1] || (bucket == 0 && directory_[bucket] != 0)) {
+      throw std::invalid_argument(filename + ": invalid directory");
+    }
+  }
+  if (directory_[n_buckets] > size - records_start) {
+    throw std::invalid_argument(filename + ": truncated records");
+  }
+  const char* roots = (const char*) (directory_ + n_buckets + 1);
+  for (uint32_t i = 0; i < n_roots; ++i) {
+    roots_.push_back(Board::Deserialize(roots + i * kSerializedBoardSize));
+  }
+  records_ = roots + n_roots * kSerializedBoardSize;
+  const char* filter = records_ + directory_[n_buckets];
+  if (!filter_.Deserialize(std::vector<char>(filter, data + size)) || filter_.NKeys() != n_records_) {
+    throw std::invalid_argument(filename + ": invalid filter");
+  }
+}
+
+void FrozenBook::Write(const std::string& filename, const std::vector<Board>& roots,
+                       std::vector<std::vector<char>> records) {
+  uint32_t bucket_bits = 0;
+  while ((kRecordsPerBucket << bucket_bits) < records.size()) {
+    ++bucket_bits;
+  }
+  std::vector<std::pair<uint32_t, std::vector<char>*>> sorted;
+  sorted.reserve(records.size());
+  BloomFilter filter;
+  filter.Reset(records.size());
+  for (std::vector<char>& record : records) {
+    sorted.emplace_back(RecordHash(record), &record);
+    filter.Add(sorted.back().first);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const auto& left, const auto& right) {
+    return left.first < right.first;
+  });
+
+  // The directory first (from the sizes), then the records, in the same order.
+  uint64_t n_buckets = 1ULL << bucket_bits;
+  std::vector<uint64_t> directory(n_buckets + 1, 0);
+  std::vector<char> length;
+  uint64_t position = 0;
+  auto record = sorted.begin();
+  for (uint64_t bucket = 0; bucket < n_buckets; ++bucket) {
+    directory[bucket] = position;
+    for (; record != sorted.end() && (bucket_bits == 0 || record->first >> (32 - bucket_bits) == bucket); ++record) {
+      length.clear();
+      AppendVarint(&length, record->second->size());
+      position += length.size() + record->second->size();
+    }
+  }
+  assert(record == sorted.end());
+  directory[n_buckets] = position;
+
+  std::ofstream file(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+  uint64_t n_records = records.size();
+  uint32_t n_roots = (uint32_t) roots.size();
+  file.write((const char*) &kMagic, sizeof(kMagic));
+  file.write((const char*) &n_records, sizeof(n_records));
+  file.write((const char*) &n_roots, sizeof(n_roots));
+  file.write((const char*) &bucket_bits, sizeof(bucket_bits));
+  file.write((const char*) directory.data(), directory.size() * sizeof(uint64_t));
+  for (const Board& root : roots) {
+    SerializedBoard serialized = root.Serialize();
+    file.write(serialized.data(), serialized.size());
+  }
+  for (const auto& [hash, record] : sorted) {
+    length.clear();
+    AppendVarint(&length, record->size());
+    file.write(length.data(), length.size());
+    file.write(record->data(), record->size());
+  }
+  std::vector<char> serialized_filter = filter.Serialize();
+  file.write(serialized_filter.data(), serialized_filter.size());
+}
+
+ValueSpan FrozenBook::Find(const Board& unique) const {
+  uint32_t hash = HashFull(unique.Player(), unique.Opponent());
+  if (!filter_.MayContain(hash)) {
+    return ValueSpan();
+  }
+  uint64_t bucket = Bucket(hash);
+  SerializedBoard key = unique.Serialize();
+  const char* end = records_ + directory_[bucket + 1];
+  for (const char* record = records_ + directory_[bucket]; record < end; ) {
+    uint64_t size;
+    record = ReadVarint(record, &size);
+    if (memcmp(record, key.data(), kSerializedBoardSize) == 0) {
+      return ValueSpan(record, (ValueFileSize) size);
+    }
+    record += size;
+  }
+  return ValueSpan();
+}
+
+void FrozenBook::ForEachRecord(const std::function<void(ValueSpan)>& f) const {
+  const char* end = records_ + directory_[1ULL << bucket_bits_];
+  for (const char* record = records_; record < end; ) {
+    uint64_t size;
+    record = ReadVarint(record, &size);
+    f(ValueSpan(record, (ValueFileSize) size));
+    record += size;
+  }
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OTHELLOSENSEI_FROZEN_BOOK_H
+#define OTHELLOSENSEI_FROZEN_BOOK_H
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "bloom_filter.h"
+#include "value_file.h"
+#include "../board/board.h"
+#include "../utils/files.h"
+
+// A read-only book in a single file, for distribution: smaller than the index
+// and the value files of a Book, and a lookup reads at most two pages.
+//
+// Format:
+// - Header: magic, number of records, number of roots, bucket bits
+//   (kHeaderSize bytes).
+// - Directory: for each of the 2^bucket_bits buckets (plus one at the end),
+//   the position of its first record, relative to the start of the records.
+// - Roots: the serialized roots of the book.
+// - Records: the serialized nodes (without the fathers and without padding),
+//   sorted by HashFull() of the board, each preceded by its length (varint).
+//   Bucket i contains the boards whose hash starts with the bits of i.
+// - Filter: a BloomFilter with the hashes, so that most lookups of boards not
+//   in the book do not scan a bucket.
+class FrozenBook {
+ public:
+  // Throws std::invalid_argument if the file is not a valid frozen book.
+  explicit FrozenBook(const std::string& filename);
+
+  static std::string Filename(const std::string& folder) { return folder + "/frozen.sen"; }
+
+  // Writes the serialized nodes (which must start with their unique board).
+  static void Write(const std::string& filename, const std::vector<Board>& roots,
+                    std::vector<std::vector<char>> records);
+
+  uint64_t Size() const { return n_records_; }
+
+  const std::vector<Board>& Roots() const { return roots_; }
+
+  // The serialized node of the board, which must be unique (an empty span if
+  // the board is not in the book).
+  ValueSpan Find(const Board& unique) const;
+
+  // Calls f(record) on each serialized node, in file order.
+  void ForEachRecord(const std::function<void(ValueSpan)>& f) const;
+
+ private:
+  static constexpr int kHeaderSize = 24;
+
+  std::unique_ptr<MappedFile> map_;
+  uint64_t n_records_;
+  std::vector<Board> roots_;
+  uint32_t bucket_bits_;
+  const uint64_t* directory_;
+  const char* records_;
+  BloomFilter filter_;
+
+  uint64_t Bucket(uint32_t hash) const {
+    return bucket_bits_ == 0 ? 0 : hash >> (32 - bucket_bits_);
+  }
+};
+
+#endif  // OTHELLOSENSEI_FROZEN_BOOK_H
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <unordered_map>
+#include "frozen_book.h"
+#include "../board/board.h"
+#include "../utils/files.h"
+
+const std::string kTempDir = "app/testdata/tmp/frozen_book_test";
+const std::string kFilename = FrozenBook::Filename(kTempDir);
+
+// A record with the board and `size` more bytes (with sizes up to 1000, so
+// that the lengths take 1 or 2 bytes).
+std::vector<char> TestRecord(const Board& unique, int size) {
+  std::vector<char> result = unique.Serialize();
+  for (int i = 0; i < size; ++i) {
+    result.push_back((char) (i * 7 + size));
+  }
+  return result;
+}
+
+TEST(FrozenBook, WriteFind) {
+  std::unordered_map<Board, std::vector<char>> expected;
+  std::vector<std::vector<char>> records;
+  for (int i = 0; i < 1000; ++i) {
+    Board unique = RandomBoard().Unique();
+    if (expected.count(unique) == 0) {
+      expected[unique] = TestRecord(unique, (i * 37) % 1000);
+      records.push_back(expected[unique]);
+    }
+  }
+  CreateEmptyFileWithDirectories(kFilename);
+  FrozenBook::Write(kFilename, {Board("e6").Unique(), Board("").Unique()}, records);
+
+  FrozenBook book(kFilename);
+  EXPECT_EQ(book.Size(), expected.size());
+  EXPECT_EQ(book.Roots(), std::vector<Board>({Board("e6").Unique(), Board("").Unique()}));
+  for (const auto& [board, record] : expected) {
+    ValueSpan found = book.Find(board);
+    ASSERT_EQ(std::vector<char>(found), record);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    Board unique = RandomBoard().Unique();
+    if (expected.count(unique) == 0) {
+      ASSERT_EQ(book.Find(unique).data(), nullptr);
+    }
+  }
+}
+
+TEST(FrozenBook, Empty) {
+  CreateEmptyFileWithDirectories(kFilename);
+  FrozenBook::Write(kFilename, {}, {});
+
+  FrozenBook book(kFilename);
+  EXPECT_EQ(book.Size(), 0);
+  EXPECT_TRUE(book.Roots().empty());
+  EXPECT_EQ(book.Find(Board("e6").Unique()).data(), nullptr);
+}
+
+TEST(FrozenBook, Invalid) {
+  std::vector<std::vector<char>> records;
+  for (int i = 0; i < 100; ++i) {
+    records.push_back(TestRecord(RandomBoard().Unique(), i));
+  }
+  CreateEmptyFileWithDirectories(kFilename);
+  FrozenBook::Write(kFilename, {Board("e6").Unique()}, records);
+  std::vector<char> content = ReadFile<char>(kFilename);
+
+  auto write = [](const std::vector<char>& content) {
+    std::ofstream(kFilename, std::ios::binary | std::ios::trunc).write(content.data(), content.size());
+  };
+  for (size_t size : {(size_t) 0, (size_t) 10, (size_t) 30, content.size() / 2, content.size() - 1}) {
+    write(std::vector<char>(content.begin(), content.begin() + size));
+    EXPECT_THROW(FrozenBook book(kFilename), std::invalid_argument) << size;
+  }
+  // Wrong magic, too many bucket bits, a directory going backwards.
+  for (int byte : {0, 20, 24 + 8 + 7}) {
+    std::vector<char> corrupted(content);
+    corrupted[byte] = (char) 0xFF;
+    write(corrupted);
+    EXPECT_THROW(FrozenBook book(kFilename), std::invalid_argument) << byte;
+  }
+  write(content);
+  EXPECT_EQ(FrozenBook(kFilename).Size(), records.size());
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OTHELLOSENSEI_LRU_CACHE_H
+#define OTHELLOSENSEI_LRU_CACHE_H
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+
+// A thread-safe cache with at most Capacity() elements, that evicts the least
+// recently used one. With capacity 0, it stores nothing.
+template<class Key, class Value, class Hash = std::hash<Key>>
+class LruCache {
+ public:
+  explicit LruCache(size_t capacity = 0) : capacity_(capacity), hits_(0), misses_(0) {}
+
+  size_t Capacity() const { return capacity_; }
+
+  void SetCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    capacity_ = capacity;
+    Shrink();
+  }
+
+  // Returns the value of key, using compute() to build it if it is not in the
+  // cache. Concurrent misses are serialized, so compute() never runs in
+  // parallel with itself.
+  template<class Compute>
+  Value GetOrCompute(const Key& key, Compute compute) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto iterator = index_.find(key);
+    if (iterator != index_.end()) {
+      ++hits_;
+      // Moves the element to the front (most recently used).
+      entries_.splice(entries_.begin(), entries_, iterator->second);
+      return iterator->second->second;
+    }
+    ++misses_;
+    Value value = compute();
+    if (capacity_ > 0) {
+      entries_.emplace_front(key, value);
+      index_[key] = entries_.begin();
+      Shrink();
+    }
+    return value;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    entries_.clear();
+    index_.clear();
+  }
+
+  size_t Size() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return entries_.size();
+  }
+
+  uint64_t Hits() const { return hits_; }
+  uint64_t Misses() const { return misses_; }
+
+ private:
+  mutable std::mutex mutex_;
+  // Only changed under mutex_, but atomic so that Capacity() does not lock.
+  std::atomic_size_t capacity_;
+  // Most recently used first.
+  std::list<std::pair<Key, Value>> entries_;
+  std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> index_;
+  std::atomic_uint64_t hits_;
+  std::atomic_uint64_t misses_;
+
+  void Shrink() {
+    while (entries_.size() > capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+};
+
+#endif  // OTHELLOSENSEI_LRU_CACHE_H
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <future>
+#include "lru_cache.h"
+
+TEST(LruCacheTest, HitsAndMisses) {
+  LruCache<int, int> cache(2);
+  int n_computed = 0;
+  auto square = [&](int i) { return [&n_computed, i]() { ++n_computed; return i * i; }; };
+  EXPECT_EQ(cache.GetOrCompute(3, square(3)), 9);
+  EXPECT_EQ(cache.GetOrCompute(3, square(3)), 9);
+  EXPECT_EQ(n_computed, 1);
+  EXPECT_EQ(cache.Hits(), 1);
+  EXPECT_EQ(cache.Misses(), 1);
+}
+
+TEST(LruCacheTest, EvictsLeastRecentlyUsed) {
+  LruCache<int, int> cache(2);
+  int n_computed = 0;
+  auto square = [&](int i) { return [&n_computed, i]() { ++n_computed; return i * i; }; };
+  cache.GetOrCompute(1, square(1));
+  cache.GetOrCompute(2, square(2));
+  // 1 becomes the most recently used, so 2 is evicted.
+  cache.GetOrCompute(1, square(1));
+  cache.GetOrCompute(3, square(3));
+  EXPECT_EQ(cache.Size(), 2);
+  EXPECT_EQ(n_computed, 3);
+  cache.GetOrCompute(1, square(1));
+  EXPECT_EQ(n_computed, 3);
+  cache.GetOrCompute(2, square(2));
+  EXPECT_EQ(n_computed, 4);
+}
+
+TEST(LruCacheTest, ZeroCapacity) {
+  LruCache<int, int> cache;
+  cache.GetOrCompute(1, []() { return 1; });
+  EXPECT_EQ(cache.Size(), 0);
+  cache.SetCapacity(1);
+  cache.GetOrCompute(1, []() { return 1; });
+  EXPECT_EQ(cache.Size(), 1);
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+TEST(LruCacheTest, Concurrent) {
+  LruCache<int, int> cache(64);
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < 4; ++i) {
+    futures.push_back(std::async(std::launch::async, [&cache, i]() {
+      for (int j = 0; j < 10000; ++j) {
+        int key = (i * 7 + j) % 100;
+        ASSERT_EQ(cache.GetOrCompute(key, [key]() { return 2 * key; }), 2 * key);
+      }
+    }));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+  EXPECT_EQ(cache.Size(), 64);
+  EXPECT_EQ(cache.Hits() + cache.Misses(), 40000);
+}
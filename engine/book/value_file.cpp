@@ -30,6 +30,8 @@ BookFileOffset ValueFile::Add(const std::vector<char>& value) {
   file.read((char*) &offset, sizeof(offset));
   if (offset == 0) {
     offset = Elements();
+    // The file grows: the next read remaps it.
+    map_ = nullptr;
   } else {
     Seek(offset, file);
     BookFileOffset new_offset;
@@ -56,11 +58,6 @@ std::vector<char> ValueFile::Remove(BookFileOffset offset) {
   return result;
 }
 
-std::vector<char> ValueFile::Get(BookFileOffset offset) const {
-  std::shared_ptr<std::fstream> file = GetFileCached();
-  return Get(offset, *file);
-}
-
 std::vector<char> ValueFile::Get(BookFileOffset offset, std::fstream& file) const {
   std::vector<char> result(size_);
   Seek(offset, file);
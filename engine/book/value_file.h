@@ -23,6 +23,7 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_set>
@@ -35,11 +36,33 @@ typedef int ValueFileSize;
 
 constexpr ValueFileSize kMinValueFileSize = sizeof(BookFileOffset);
 
+// A value in a ValueFile, pointing to the memory mapping of the file. It is
+// only valid until the next write to the file.
+class ValueSpan {
+ public:
+  ValueSpan() : data_(nullptr), size_(0) {}
+  ValueSpan(const char* data, ValueFileSize size) : data_(data), size_(size) {}
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+  char operator[](size_t i) const { return data_[i]; }
+
+  operator std::vector<char>() const { return std::vector<char>(begin(), end()); }
+
+ private:
+  const char* data_;
+  ValueFileSize size_;
+};
+
 // A file that can store vector<char> with the same size (at least kMinSize=4).
 // Supports the following operations:
 // - Add(): Adds a new element.
 // - Remove(): Removes the element. The space used by the element is reused in
 //   next Add() calls.
+// Reads go through a read-only memory mapping of the file, which is remapped
+// when Add() makes the file grow.
 class ValueFile {
  public:
   ValueFile(std::string filename, ValueFileSize size) : filename_(filename), size_(size), cached_file_(nullptr) {
@@ -52,22 +75,46 @@ class ValueFile {
 
   ValueFileSize Size() const { return size_; }
 
+  const std::string& Filename() const { return filename_; }
+
   BookFileOffset Add(const std::vector<char>& value);
 
   std::vector<char> Remove(BookFileOffset offset);
 
-  std::vector<char> Get(BookFileOffset offset) const;
+  std::vector<char> Get(BookFileOffset offset) const { return View(offset); }
+
+  ValueSpan View(BookFileOffset offset) const {
+    const std::shared_ptr<MappedFile>& map = Map((offset + 1) * (size_t) size_);
+    return ValueSpan(map->Data() + offset * (size_t) size_, size_);
+  }
 
   void Clean() {
+    map_ = nullptr;
     CreateEmptyFileWithDirectories(filename_);
     auto file = GetFile();
     SetAsEmpty(0, 0, file);
   }
 
   void Remove() {
+    map_ = nullptr;
     remove(filename_.c_str());
   }
 
+  // Drops the cached views of the file, after it was written from outside.
+  void Reload() {
+    map_ = nullptr;
+    cached_file_ = nullptr;
+  }
+
+  // The first empty element (0 if none), and the one after element `offset`
+  // in the list of empty elements.
+  BookFileOffset FirstEmpty() const { return NextEmpty(0); }
+  BookFileOffset NextEmpty(BookFileOffset offset) const {
+    BookFileOffset next;
+    memcpy(&next, View(offset).data(), sizeof(next));
+    return next;
+  }
+
   BookFileOffset Elements() const {
     std::shared_ptr<std::fstream> file = GetFileCached();
     return (BookFileOffset) (FileLength(*file) / size_);
@@ -79,31 +126,30 @@ class ValueFile {
    public:
     using iterator_category = std::forward_iterator_tag;
     using difference_type   = std::ptrdiff_t;
-    using value_type        = std::pair<BookFileOffset, std::vector<char>>;
-    using pointer           = value_type*;  // or also value_type*
-    using reference         = const value_type&;  // or also value_type&
+    using value_type        = std::pair<BookFileOffset, ValueSpan>;
+    using pointer           = const value_type*;
+    using reference         = const value_type&;
 
-    Iterator(const ValueFile* file, BookFileOffset offset) : current_(offset, std::vector<char>()), size_(file->Size()) {
+    Iterator(const ValueFile* file, BookFileOffset offset) : current_(offset, ValueSpan()), size_(file->Size()) {
       assert (offset == 0 || offset == file->Elements());
 
       if (offset == 0) {
-        std::shared_ptr<std::fstream> fstream = file->GetFileCached();
-        file->Seek(0, *fstream);
-        values_.resize(FileLength(*fstream));
-        fstream->read(values_.data(), values_.size());
-
+        // Keeps the mapping alive even if the file remaps. The mapping must
+        // cover all the elements, also if the file was written from outside
+        // (e.g., by a commit).
+        map_ = file->Map(file->Elements() * (size_t) size_);
+        is_empty_.resize(map_->Size() / size_, false);
+        // Follows the list of free elements, starting from the head at 0.
         BookFileOffset empty = 0;
-        empty = *((BookFileOffset*) values_.data() + empty * size_);
-        empties_.insert(empty);
-        while (empty != 0) {
-          empty = *((BookFileOffset*) (values_.data() + empty * size_));
-          empties_.insert(empty);
-        }
+        do {
+          memcpy(&empty, map_->Data() + empty * (size_t) size_, sizeof(empty));
+          is_empty_[empty] = true;
+        } while (empty != 0);
         ToNextNonEmpty();
       }
     }
     reference operator*() const { return current_; }
-    pointer operator->() { return &current_; }
+    pointer operator->() const { return &current_; }
 
     // Prefix increment
     Iterator& operator++() {
@@ -120,27 +166,25 @@ class ValueFile {
     }
 
     bool operator==(const Iterator& other) const {
-      return current_ == other.current_ && size_ == other.size_;
+      return current_.first == other.current_.first && size_ == other.size_;
     }
     bool operator!=(const Iterator& other) const { return !operator==(other); }
 
    private:
-    std::pair<BookFileOffset, std::vector<char>> current_;
-    std::unordered_set<BookFileOffset> empties_;
+    std::shared_ptr<MappedFile> map_;
+    std::pair<BookFileOffset, ValueSpan> current_;
+    std::vector<bool> is_empty_;
     int size_;
-    std::vector<char> values_;
 
     void ToNextNonEmpty() {
       auto& offset = current_.first;
-      auto& value = current_.second;
-      while (empties_.find(offset) != empties_.end() && offset < values_.size()) {
+      while (offset < is_empty_.size() && is_empty_[offset]) {
         ++offset;
       }
-      if (offset * size_ < values_.size()) {
-        value.resize(size_);
-        std::memcpy(value.data(), values_.data() + offset * size_, size_);
+      if (offset < is_empty_.size()) {
+        current_.second = ValueSpan(map_->Data() + offset * (size_t) size_, size_);
       } else {
-        value.clear();
+        current_.second = ValueSpan();
       }
     }
   };
@@ -152,6 +196,24 @@ class ValueFile {
   std::string filename_;
   ValueFileSize size_;
   mutable std::shared_ptr<std::fstream> cached_file_;
+  mutable std::shared_ptr<MappedFile> map_;
+
+  // Returns the mapping, remapping the file if it is shorter than min_size
+  // (for example, if another ValueFile on the same file added elements).
+  // Concurrent readers can call it: if several of them map the file, only the
+  // first mapping is stored and returned to all of them. Otherwise, replacing
+  // map_ would unmap the file under the spans that the others returned.
+  std::shared_ptr<MappedFile> Map(size_t min_size) const {
+    std::shared_ptr<MappedFile> map = std::atomic_load(&map_);
+    while (map == nullptr || map->Size() < min_size) {
+      std::shared_ptr<MappedFile> new_map = std::make_shared<MappedFile>(filename_);
+      // On failure, map is the mapping stored by another reader.
+      if (std::atomic_compare_exchange_strong(&map_, &map, new_map)) {
+        return new_map;
+      }
+    }
+    return map;
+  }
 
   std::fstream GetFile() const;
   std::shared_ptr<std::fstream> GetFileCached() const;
@@ -16,6 +16,7 @@
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <future>
 #include "../utils/files.h"
 #include "value_file.h"
 
@@ -113,6 +114,58 @@ TEST(ValueFile, AddAndRemove) {
   value_file.Remove();
 }
 
+TEST(ValueFile, View) {
+  ValueFile value_file(kTempFile, 5);
+  value_file.Clean();
+
+  std::vector<char> values1 = {0, 1, 2, 3, 4};
+  BookFileOffset offset1 = value_file.Add(values1);
+  EXPECT_EQ(std::vector<char>(value_file.View(offset1)), values1);
+
+  // Another ValueFile makes the file grow: the view remaps it.
+  ValueFile value_file_copy(kTempFile, 5);
+  std::vector<char> values2 = {1, 1, 2, 3, 4};
+  BookFileOffset offset2 = value_file_copy.Add(values2);
+  EXPECT_EQ(std::vector<char>(value_file.View(offset2)), values2);
+
+  // Writes without growing are visible in the current mapping.
+  value_file.Remove(offset1);
+  std::vector<char> values3 = {2, 1, 2, 3, 4};
+  EXPECT_EQ(value_file.Add(values3), offset1);
+  EXPECT_EQ(std::vector<char>(value_file.View(offset1)), values3);
+  EXPECT_EQ(std::vector<char>(value_file.View(offset2)), values2);
+  value_file.Remove();
+}
+
+TEST(ValueFile, ConcurrentView) {
+  ValueFile value_file(kTempFile, 5);
+  value_file.Clean();
+  std::vector<BookFileOffset> offsets;
+  for (int i = 0; i < 1000; ++i) {
+    offsets.push_back(value_file.Add({(char) i, 1, 2, 3, 4}));
+  }
+  for (int run = 0; run < 20; ++run) {
+    // All the threads find no mapping, and they map the file at the same time.
+    value_file.Reload();
+    std::vector<std::future<bool>> futures;
+    for (int thread = 0; thread < 8; ++thread) {
+      futures.push_back(std::async(std::launch::async, [&value_file, &offsets]() {
+        // The first span must stay valid while the others map the file.
+        ValueSpan first = value_file.View(offsets[0]);
+        bool correct = true;
+        for (int i = 0; i < offsets.size(); ++i) {
+          correct = correct && value_file.View(offsets[i])[0] == (char) i;
+        }
+        return correct && std::vector<char>(first) == std::vector<char>({0, 1, 2, 3, 4});
+      }));
+    }
+    for (auto& future : futures) {
+      EXPECT_TRUE(future.get());
+    }
+  }
+  value_file.Remove();
+}
+
 TEST(ValueFile, Iterator) {
   ValueFile value_file(kTempFile, 5);
   EXPECT_EQ(value_file.Elements(), 1);
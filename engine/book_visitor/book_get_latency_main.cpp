@@ -0,0 +1,103 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the latency of Book::Get, with the access pattern of the app: it
+// runs random walks from the starting position, and at each step it looks up
+// all the children of the current position (both hits and misses), then moves
+// to a random child in the book.
+//
+// Usage:
+// ./build/book_visitor/book_get_latency_main --book_path=assets/book \
+//     --n_walks=10000 --cache_capacity=4096
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include "../board/board.h"
+#include "../board/get_moves.h"
+#include "../book/book.h"
+#include "../utils/parse_flags.h"
+
+void PrintPercentiles(const std::string& name, std::vector<double> latencies) {
+  std::cout << std::setw(6) << name << ": " << std::setw(9) << latencies.size() << " calls";
+  if (latencies.empty()) {
+    std::cout << "\n";
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << std::fixed << std::setprecision(2);
+  for (auto [label, p] : {std::make_pair("p50", 0.5), {"p90", 0.9}, {"p99", 0.99}, {"p99.9", 0.999}}) {
+    std::cout << "  " << label << "=" << latencies[(size_t) (p * (latencies.size() - 1))] << "us";
+  }
+  std::cout << "  max=" << latencies.back() << "us\n";
+}
+
+int main(int argc, char* argv[]) {
+  ParseFlags parse_flags(argc, argv);
+  std::string book_path = parse_flags.GetFlag("book_path");
+  int n_walks = parse_flags.GetIntFlagOrDefault("n_walks", 1000);
+  int seed = parse_flags.GetIntFlagOrDefault("seed", 0);
+  int cache_capacity = parse_flags.GetIntFlagOrDefault("cache_capacity", 0);
+
+  Book<> book(book_path);
+  book.SetCacheCapacity(cache_capacity);
+  std::mt19937 rng(seed);
+  std::vector<double> hits;
+  std::vector<double> misses;
+
+  auto timed_get = [&](const Board& b) {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<Node> node = book.Get(b);
+    double latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    (node ? hits : misses).push_back(latency);
+    return node != nullptr;
+  };
+
+  for (int i = 0; i < n_walks; ++i) {
+    Board b;
+    if (!timed_get(b)) {
+      std::cout << "The starting position is not in the book\n";
+      return 1;
+    }
+    while (true) {
+      std::vector<Board> in_book;
+      for (const Board& child : GetNextBoardsWithPass(b)) {
+        if (timed_get(child)) {
+          in_book.push_back(child);
+        }
+      }
+      if (in_book.empty()) {
+        break;
+      }
+      b = in_book[rng() % in_book.size()];
+    }
+  }
+  std::cout << "Book with " << book.Size() << " positions, " << n_walks << " walks\n";
+  std::vector<double> all(hits);
+  all.insert(all.end(), misses.begin(), misses.end());
+  PrintPercentiles("hits", hits);
+  PrintPercentiles("misses", misses);
+  PrintPercentiles("all", all);
+  if (cache_capacity > 0) {
+    uint64_t cache_calls = book.CacheHits() + book.CacheMisses();
+    std::cout << "Cache hit rate: " << 100.0 * book.CacheHits() / cache_calls << "% ("
+              << book.CacheHits() << " / " << cache_calls << ")\n";
+  }
+  return 0;
+}
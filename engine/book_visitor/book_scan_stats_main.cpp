@@ -0,0 +1,81 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Prints the number of nodes, leaves and solved nodes in a book, by number of
+// empties. It reads the whole book with Book::Scan (sequential reads, nodes
+// deserialized in parallel), instead of visiting the tree.
+//
+// Usage:
+// ./build/book_visitor/book_scan_stats_main --book_path=assets/book --n_threads=8
+
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "../book/book.h"
+#include "../utils/misc.h"
+#include "../utils/parse_flags.h"
+
+struct EmptiesStats {
+  uint64_t nodes = 0;
+  uint64_t leaves = 0;
+  uint64_t solved = 0;
+};
+
+int main(int argc, char* argv[]) {
+  ParseFlags parse_flags(argc, argv);
+  std::string book_path = parse_flags.GetFlag("book_path");
+  // std::thread::hardware_concurrency() can return 0.
+  int n_threads = std::max(1, parse_flags.GetIntFlagOrDefault("n_threads", (int) std::thread::hardware_concurrency()));
+
+  const Book book(book_path);
+  ElapsedTime time;
+  // One result per thread, merged at the end.
+  std::vector<std::vector<EmptiesStats>> stats_by_thread(n_threads, std::vector<EmptiesStats>(61));
+  book.Scan([&stats_by_thread](Node& node, int thread) {
+    EmptiesStats& stats = stats_by_thread[thread][node.NEmpties()];
+    ++stats.nodes;
+    stats.leaves += node.IsLeaf() ? 1 : 0;
+    stats.solved += node.IsSolved() ? 1 : 0;
+  }, n_threads);
+  double seconds = time.Get();
+
+  std::vector<EmptiesStats> stats(61);
+  EmptiesStats total;
+  for (const auto& thread_stats : stats_by_thread) {
+    for (int empties = 0; empties <= 60; ++empties) {
+      stats[empties].nodes += thread_stats[empties].nodes;
+      stats[empties].leaves += thread_stats[empties].leaves;
+      stats[empties].solved += thread_stats[empties].solved;
+    }
+  }
+  std::cout << "empties      nodes     leaves     solved\n";
+  for (int empties = 60; empties >= 0; --empties) {
+    const EmptiesStats& s = stats[empties];
+    total.nodes += s.nodes;
+    total.leaves += s.leaves;
+    total.solved += s.solved;
+    if (s.nodes > 0) {
+      std::cout << std::setw(7) << empties << std::setw(11) << s.nodes
+                << std::setw(11) << s.leaves << std::setw(11) << s.solved << "\n";
+    }
+  }
+  std::cout << std::setw(7) << "total" << std::setw(11) << total.nodes
+            << std::setw(11) << total.leaves << std::setw(11) << total.solved << "\n";
+  std::cout << "Scanned " << total.nodes << " nodes in " << seconds << "s ("
+            << PrettyPrintDouble(total.nodes / seconds) << " nodes / s)\n";
+  return total.nodes == book.Size() ? 0 : 1;
+}
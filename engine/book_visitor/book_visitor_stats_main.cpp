@@ -15,6 +15,7 @@
  */
 
 #include <iostream>
+#include <sstream>
 
 #include "visitor.h"
 #include "../book/book.h"
@@ -32,16 +33,27 @@ class BookVisitorStats : public BookVisitorWithProgress<kBookVersion> {
 
   BookVisitorStats(const Book& book, const Thor<GameGetterInMemory>& archive, const std::string& output_path) :
       BookVisitorWithProgress(book),
-      archive_(archive) {
+      archive_(archive),
+      output_(std::make_shared<Output>()) {
     // 8754564 / 286170000
     std::cout << "Archive games: "
               << archive_.GetGamesFromAllSources(Sequence(""), 1).num_games << "\n";
-    output_.open(output_path);
-    output_ << "sequence,games,empties,depth,error_black,error_white,uncertainty";
+    output_->file.open(output_path);
+    output_->file << "sequence,games,empties,depth,error_black,error_white,uncertainty";
     for (int i = 1; i < 40; ++i) {
-      output_ << ",error" << i;
+      output_->file << ",error" << i;
     }
-    output_ << "\n";
+    output_->file << "\n";
+  }
+
+  // The copies write to the same output, through their own buffer.
+  BookVisitorStats(const BookVisitorStats& other) :
+      BookVisitorWithProgress(other),
+      archive_(other.archive_),
+      output_(other.output_) {}
+
+  ~BookVisitorStats() {
+    Flush();
   }
 
  protected:
@@ -54,7 +66,7 @@ class BookVisitorStats : public BookVisitorWithProgress<kBookVersion> {
     auto uncertainty = node.Uncertainty();
     if (num_thor_games > 0) {
       auto [error_black, error_white] = GetErrors();
-      output_
+      buffer_
           << sequence_ << ","
           << num_thor_games << ","
           << (int) node.NEmpties() << ","
@@ -63,9 +75,12 @@ class BookVisitorStats : public BookVisitorWithProgress<kBookVersion> {
           << error_white << ","
           << uncertainty;
       for (int i = 1; i <= depth_; ++i) {
-        output_ << "," << GetErrorAtDepth(i);
+        buffer_ << "," << GetErrorAtDepth(i);
+      }
+      buffer_ << "\n";
+      if (buffer_.tellp() > kMaxBufferSize) {
+        Flush();
       }
-      output_ << "\n";
     }
     return num_thor_games;
   }
@@ -78,9 +93,27 @@ class BookVisitorStats : public BookVisitorWithProgress<kBookVersion> {
     return VisitNode(node) > 0;
   }
 
+  // The lines of the copies are written in Flush(), so there is nothing to
+  // merge.
+  std::unique_ptr<BookVisitor> Clone() const override {
+    return std::make_unique<BookVisitorStats>(*this);
+  }
+
  private:
+  struct Output {
+    std::mutex mutex;
+    std::ofstream file;
+  };
+  static constexpr int kMaxBufferSize = 1 << 20;
   const Thor<GameGetterInMemory>& archive_;
-  std::ofstream output_;
+  std::shared_ptr<Output> output_;
+  std::ostringstream buffer_;
+
+  void Flush() {
+    std::lock_guard<std::mutex> guard(output_->mutex);
+    output_->file << buffer_.str();
+    buffer_.str("");
+  }
 };
 
 int main(int argc, char* argv[]) {
@@ -88,10 +121,11 @@ int main(int argc, char* argv[]) {
   std::string book_path = parse_flags.GetFlag("book_path");
   std::string archive_path = parse_flags.GetFlag("archive_path");
   std::string output_path = parse_flags.GetFlag("output_path");
+  int n_threads = parse_flags.GetIntFlagOrDefault("n_threads", (int) std::thread::hardware_concurrency());
 
   const Book book(book_path);
   Thor<GameGetterInMemory> archive(archive_path, output_path + "/saved_games_filepath.txt");
 
   BookVisitorStats visitor(book, archive, output_path);
-  visitor.VisitString("");
+  visitor.VisitStringParallel("", n_threads);
 }
\ No newline at end of file
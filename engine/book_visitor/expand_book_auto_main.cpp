@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <limits>
@@ -86,13 +87,17 @@ class BookVisitorBestLines : public BookVisitorWithProgress<kBookVersion> {
     }
     auto [error_black, error_white] = GetErrors();
 
-    BoardWithStats board {
+    AddPosition(BoardWithStats {
       sequence_.ToString(),
       node.ToBoard(),
       error_black + error_white,
       node.Uncertainty(),
       depth_,
-      num_thor_games};
+      num_thor_games});
+    return true;
+  }
+
+  void AddPosition(BoardWithStats board) {
     if (best_positions_.size() >= num_positions_) {
       // Highest value = the worst one in terms of priority, as it's a minus.
       if (board.GetValue() < best_positions_.top().GetValue()) {
@@ -102,7 +107,6 @@ class BookVisitorBestLines : public BookVisitorWithProgress<kBookVersion> {
     } else {
       best_positions_.push(std::move(board));
     }
-    return true;
   }
 
   void VisitLeaf(Node& node) override {
@@ -113,6 +117,20 @@ class BookVisitorBestLines : public BookVisitorWithProgress<kBookVersion> {
     return VisitNode(node);
   }
 
+  std::unique_ptr<BookVisitor> Clone() const override {
+    auto clone = std::make_unique<BookVisitorBestLines>(*this);
+    clone->best_positions_ = BestPositionsPriorityQueue();
+    return clone;
+  }
+
+  void Merge(const BookVisitor& other) override {
+    BestPositionsPriorityQueue positions = static_cast<const BookVisitorBestLines&>(other).best_positions_;
+    while (!positions.empty()) {
+      AddPosition(positions.top());
+      positions.pop();
+    }
+  }
+
  private:
   const Thor<GameGetterInMemory>& archive_;
   const int num_positions_;
@@ -120,10 +138,11 @@ class BookVisitorBestLines : public BookVisitorWithProgress<kBookVersion> {
   const int min_games_;
 };
 
-std::string GetBestBoard(Book<>& book, const std::vector<BoardWithStats>& boards) {
-  BoardWithStats best_board = boards[0];
-  double best = DBL_MAX;
-  std::cout << "Choosing line\n";
+// Returns the lines sorted by value (best first), with their current
+// uncertainty in the book.
+std::vector<BoardWithStats> RankLines(Book<>& book, const std::vector<BoardWithStats>& boards) {
+  std::vector<BoardWithStats> result;
+  std::cout << "Choosing lines\n";
   int max_line_length = 0;
   for (const auto& board : boards) {
     max_line_length = std::max(max_line_length, (int) board.line.size());
@@ -137,12 +156,167 @@ std::string GetBestBoard(Book<>& book, const std::vector<BoardWithStats>& boards
     snprintf(format_value_eval, 39, "%6.2f  %5d  %6.2f  %8.6f  %+2.2f", board.error, board.depth, uncertainty, value, board_in_book->GetEval());
     std::cout << "  "
         << std::setw(max_line_length) << board.line << "  " << format_value_eval << "\n";
-    if (value < best) {
-      best = value;
-      best_board = board;
+    result.push_back(board);
+    result.back().uncertainty = uncertainty;
+  }
+  std::stable_sort(result.begin(), result.end(), [](const BoardWithStats& left, const BoardWithStats& right) {
+    return left.GetValue() < right.GetValue();
+  });
+  return result;
+}
+
+// The evaluation of a leaf of the book, computed by a LineExpander.
+struct ExpandResult {
+  bool tried_solve = false;
+  bool solved = false;
+  Eval lower = kLessThenMinEval;
+  Eval upper = kLessThenMinEval;
+  std::vector<Node> children;
+  NVisited n_visited = 0;
+};
+
+// Evaluates leaves of the book. Each expander has its own TreeNodeSupplier and
+// evaluators (they only share the transposition table), so that several
+// expanders can run at the same time. They never touch the book: the main
+// thread adds their results and commits.
+class LineExpander {
+ public:
+  LineExpander(HashMap<kBitHashMap>* hash_map, const int8_t* evals, int n_threads,
+               NVisited n_descendants_children, NVisited n_descendants_solve) :
+      n_threads_(n_threads),
+      n_descendants_children_(n_descendants_children),
+      n_descendants_solve_(n_descendants_solve) {
+    for (int i = 0; i < evaluators_.size(); ++i) {
+      evaluators_[i] = std::make_unique<EvaluatorDerivative>(
+          &tree_node_supplier_, hash_map,
+          PatternEvaluator::Factory(evals),
+          static_cast<uint8_t>(i));
+    }
+  }
+
+  // Tries to solve the leaf if there is little work left, then (if it did not
+  // solve it) evaluates its children.
+  ExpandResult Expand(Board board, Eval alpha, Eval beta, double remaining_work) {
+    ExpandResult result;
+    tree_node_supplier_.Reset();
+    if (remaining_work < (double) n_descendants_solve_) {
+      auto evaluator = evaluators_[0].get();
+      evaluator->Evaluate(board.Player(), board.Opponent(), alpha, beta, 5 * n_descendants_solve_, 240, n_threads_, false);
+      auto position = evaluator->GetFirstPosition();
+      assert(position);
+      result.tried_solve = true;
+      result.lower = position->Lower();
+      result.upper = position->Upper();
+      result.n_visited += position->GetNVisited();
+      result.solved = result.upper <= alpha || result.lower == result.upper || result.lower >= beta;
+    }
+    if (!result.solved) {
+      tree_node_supplier_.Reset();
+      int i = 0;
+      for (auto child_flip : GetUniqueNextBoardsWithPass(board)) {
+        auto child = child_flip.first;
+        auto evaluator = evaluators_[++i].get();
+        evaluator->Evaluate(
+            child.Player(), child.Opponent(), -63, 63, n_descendants_children_ / 100, 300, n_threads_);
+        auto early_result = evaluator->GetFirstPosition();
+        assert(early_result);
+        // At least evaluate 10M nodes.
+        auto remaining_work = std::max((NVisited) 300000000, (NVisited) early_result->RemainingWork(alpha, beta));
+        evaluator->ContinueEvaluate(
+            std::min(n_descendants_children_, (NVisited) remaining_work / 30), 300, n_threads_);
+        auto child_result = evaluator->GetFirstPosition();
+        assert(child_result);
+        result.children.push_back(*child_result);
+        result.n_visited += child_result->GetNVisited();
+      }
+    }
+    return result;
+  }
+
+ private:
+  TreeNodeSupplier tree_node_supplier_;
+  std::array<std::unique_ptr<EvaluatorDerivative>, 64> evaluators_;
+  int n_threads_;
+  NVisited n_descendants_children_;
+  NVisited n_descendants_solve_;
+};
+
+// A leaf of the book that a LineExpander is evaluating.
+struct Expansion {
+  std::string line;
+  LeafToUpdate<Book<>::BookNode> leaf;
+  LineExpander* expander;
+  std::future<ExpandResult> result;
+  ElapsedTime time;
+};
+
+// Locks the best leaf below the line (nullptr if the line has no leaf to
+// expand, e.g. because other expansions locked it). The n_thread_multiplier
+// steers the descent away from the nodes above the running expansions.
+std::unique_ptr<LeafToUpdate<Book<>::BookNode>> BestLeaf(
+    Book<>& book, const std::string& line, float n_thread_multiplier) {
+  std::vector<Board> line_boards;
+  Board start_board(line, &line_boards);
+  std::vector<Book<>::BookNode*> line_in_book;
+  for (const Board& line_board : line_boards) {
+    auto board_in_book = book.Mutable(line_board);
+    if (board_in_book) {
+      line_in_book.push_back(board_in_book);
+    } else {
+      line_in_book.clear();
+    }
+  }
+  Book<>::BookNode* start = book.Mutable(start_board);
+  assert(start);
+  if (start->Node::IsSolved()) {
+    return nullptr;
+  }
+  Eval last_eval_goal = kLessThenMinEval;
+  // TODO: Avoid duplication with BestDescendant.
+  Eval eval_goal = start->NextPositionEvalGoal(0, 1, start->SolveProbability(-63, 63) > 0.05 ? kLessThenMinEval : last_eval_goal);
+  auto leaf = LeafToUpdate<Book<>::BookNode>::BestDescendant(start, n_thread_multiplier, last_eval_goal, line_in_book);
+  if (!leaf) {
+    return nullptr;
+  }
+  assert(leaf->Alpha() <= leaf->EvalGoal() && leaf->EvalGoal() <= leaf->Beta());
+  std::cout
+      << "Expanding line:        " << line << "\n"
+      << "Positions:             " << PrettyPrintDouble((double) book.Size()) << "\n"
+      << "Descendants of start:  " << PrettyPrintDouble((double) start->GetNVisited()) << "\n"
+      << "Evaluation of start:   " << std::setprecision(3) << start->GetEval() << "\n"
+      << "Advancement            " << (int) start->Advancement(-64, 64) << "\n"
+      << "Missing:               " << PrettyPrintDouble(start->RemainingWork(-63, 63)) << "\n"
+      << "Eval goal:             " << (int) eval_goal << "\n"
+      << "Remaining work:        " << PrettyPrintDouble(leaf->Leaf()->RemainingWork(leaf->Alpha(), leaf->Beta())) << "\n"
+      << "Board:\n" << Indent(leaf->Leaf()->ToBoard().ToString(), "                       ");
+  return leaf;
+}
+
+// Adds the result of the expansion to the book (without committing).
+void AddToBook(Book<>& book, Expansion& expansion, ExpandResult result) {
+  auto node = expansion.leaf.Leaf();
+  std::cout << "Expanded line:         " << expansion.line << "\n";
+  if (result.tried_solve) {
+    node->SetLower(result.lower);
+    node->SetUpper(result.upper);
+    if (result.solved) {
+      std::cout << "Solved: " << (int) result.lower << " <= eval <= " << (int) result.upper << "\n";
+    } else {
+      std::cout << "Did not solve it in time\n";
     }
+  } else {
+    std::cout << "Too early to solve\n";
   }
-  return best_board.line;
+  if (!result.solved) {
+    std::cout << "Added " << result.children.size() << " children\n";
+    book.AddChildren(node->ToBoard(), result.children);
+  }
+  expansion.leaf.Finalize(result.n_visited);
+  double time = expansion.time.Get();
+  std::cout << "Position:              " << PrettyPrintDouble((double) result.n_visited) << "\n";
+  std::cout << "Time:                  " << PrettyPrintDouble(time) << " sec\n";
+  std::cout << "Positions / sec:       " << PrettyPrintDouble((double) result.n_visited / time) << "\n";
+  std::cout << "\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -155,18 +329,28 @@ int main(int argc, char* argv[]) {
   NVisited n_descendants_solve = parse_flags.GetLongLongFlagOrDefault("n_descendants_solve",  4 * 1000 * 1000 * 1000LL);
   int n_threads = parse_flags.GetIntFlagOrDefault("n_threads", (int)std::thread::hardware_concurrency());
   bool force_first_position = parse_flags.GetBoolFlagOrDefault("force_first_position", false);
+  // Lines expanded at the same time, each with n_threads / n_workers threads
+  // (each worker allocates its own TreeNodeSupplier, about 450 MB).
+  int n_workers = parse_flags.GetIntFlagOrDefault("n_workers", 1);
+  // Expansions between two commits. The book is committed when no expansion is
+  // running, so the workers finish their current line before each commit.
+  int commit_every = parse_flags.GetIntFlagOrDefault("commit_every", n_workers);
+  if (n_workers <= 0 || commit_every <= 0) {
+    std::cout << "--n_workers and --commit_every must be positive.\n";
+    return 1;
+  }
+  // With one worker, nothing else is running (as in the single threaded
+  // version). Otherwise, same starting value as in EvaluatorDerivative.
+  float n_thread_multiplier = n_workers == 1 ? 0 : 10000.0f * n_workers * n_workers;
 
   fs::create_directories(book_path);
   Book<> book(book_path);
   HashMap<kBitHashMap> hash_map;
   auto evals = LoadEvals();
-  TreeNodeSupplier tree_node_supplier;
-  std::array<std::unique_ptr<EvaluatorDerivative>, 64> evaluators;
-  for (int i = 0; i < evaluators.size(); ++i) {
-    evaluators[i] = std::make_unique<EvaluatorDerivative>(
-        &tree_node_supplier, &hash_map,
-        PatternEvaluator::Factory(evals.data()),
-        static_cast<uint8_t>(i));
+  std::vector<std::unique_ptr<LineExpander>> expanders;
+  for (int i = 0; i < n_workers; ++i) {
+    expanders.push_back(std::make_unique<LineExpander>(
+        &hash_map, evals.data(), std::max(1, n_threads / n_workers), n_descendants_children, n_descendants_solve));
   }
   if (!book.Get(Board(start_line))) {
     if (!force_first_position) {
@@ -183,115 +367,89 @@ int main(int argc, char* argv[]) {
   }
   Thor<GameGetterInMemory> archive(archive_path, "");
   std::vector<BoardWithStats> best_boards;
+  std::vector<Expansion> expansions;
+  std::vector<LineExpander*> idle_expanders;
+  for (auto& expander : expanders) {
+    idle_expanders.push_back(expander.get());
+  }
+  HashMapIndex initial_book_size = book.Size();
+  ElapsedTime total_time;
+  int n_expansions = 0;
+  int n_expansions_since_commit = 0;
+  int next_best_lines = 0;
 
-  for (int step = 0; true; ++step) {
-    std::cout << "Step "<< step << "\n";
-    if (step % 300 == 0) {
+  // The main thread is the only one that reads or writes the book: it starts
+  // the expansions, adds their results, and commits.
+  while (true) {
+    if (n_expansions >= next_best_lines && expansions.empty()) {
       BookVisitorBestLines visitor(book, archive, 90, min_games);
-      visitor.VisitString(start_line);
+      visitor.VisitStringParallel(start_line, n_threads);
       BestPositionsPriorityQueue best_boards_queue = visitor.Get();
       best_boards.clear();
       while (!best_boards_queue.empty()) {
         best_boards.emplace_back(best_boards_queue.top());
         best_boards_queue.pop();
       }
+      next_best_lines = n_expansions + 300;
     }
-    std::string current_line = GetBestBoard(book, best_boards);
-    Eval last_eval_goal = kLessThenMinEval;
-    std::vector<Board> current_line_boards;
-    Board start_board(current_line, &current_line_boards);
-    ElapsedTime t;
-    std::vector<Book<>::BookNode*> current_line_in_book;
-    for (const Board& current_line_board : current_line_boards) {
-      auto board_in_book = book.Mutable(current_line_board);
-      if (board_in_book) {
-        current_line_in_book.push_back(board_in_book);
-      } else {
-        current_line_in_book.clear();
+    if (n_expansions_since_commit < commit_every && !idle_expanders.empty()) {
+      std::vector<BoardWithStats> lines = RankLines(book, best_boards);
+      // Each expander gets the best leaf of the best line that has one (the
+      // same line can have several leaves, in different subtrees).
+      while (!idle_expanders.empty()) {
+        std::unique_ptr<LeafToUpdate<Book<>::BookNode>> leaf;
+        const BoardWithStats* line = nullptr;
+        for (const BoardWithStats& candidate : lines) {
+          leaf = BestLeaf(book, candidate.line, n_thread_multiplier);
+          if (leaf) {
+            line = &candidate;
+            break;
+          }
+        }
+        if (!leaf) {
+          break;
+        }
+        LineExpander* expander = idle_expanders.back();
+        idle_expanders.pop_back();
+        auto node = leaf->Leaf();
+        double remaining_work = node->RemainingWork(leaf->Alpha(), leaf->Beta());
+        std::future<ExpandResult> result = std::async(
+            std::launch::async, &LineExpander::Expand, expander, node->ToBoard(),
+            leaf->Alpha(), leaf->Beta(), remaining_work);
+        expansions.push_back(Expansion {line->line, *leaf, expander, std::move(result), ElapsedTime()});
       }
-    }
-    Book<>::BookNode* start = book.Mutable(start_board);
-    assert(start);
-    if (start->Node::IsSolved()) {
-      std::cout << "Solved the position!\n";
-      break;
-    }
-    tree_node_supplier.Reset();
-    NVisited n_visited = 0;
-    // TODO: Avoid duplication with BestDescendant.
-    Eval eval_goal = start->NextPositionEvalGoal(0, 1, start->SolveProbability(-63, 63) > 0.05 ? kLessThenMinEval : last_eval_goal);
-    std::cout
-        << "Expanding line:        " << current_line << "\n"
-        << "Positions:             " << PrettyPrintDouble((double) book.Size()) << "\n"
-        << "Descendants of start:  " << PrettyPrintDouble((double) start->GetNVisited()) << "\n"
-        << "Evaluation of start:   " << std::setprecision(3) << start->GetEval() << "\n"
-        << "Advancement            " << (int) start->Advancement(-64, 64) << "\n"
-        << "Missing:               " << PrettyPrintDouble(start->RemainingWork(-63, 63)) << "\n"
-        << "Eval goal:             " << (int) eval_goal << "\n";
-
-    auto leaf_ptr = LeafToUpdate<Book<>::BookNode>::BestDescendant(start, 0, last_eval_goal, current_line_in_book);
-    assert(leaf_ptr);
-    auto leaf = *leaf_ptr;
-    last_eval_goal = eval_goal;
-    bool solved = false;
-    int alpha = (int) leaf.Alpha();
-    int beta = (int) leaf.Beta();
-    auto node = leaf.Leaf();
-    auto remaining_work = node->RemainingWork((Eval) alpha, (Eval)beta);
-    assert(leaf.Alpha() <= leaf.EvalGoal() && leaf.EvalGoal() <= leaf.Beta());
-    std::cout
-        << "Remaining work:        " << PrettyPrintDouble(remaining_work) << "\n"
-        << "Board:\n" << Indent(leaf.Leaf()->ToBoard().ToString(), "                       ");
-    if (remaining_work < (double) n_descendants_solve) {
-      std::cout << "Solving with alpha=" << alpha << " beta=" << beta << "\n";
-      auto evaluator = evaluators[0].get();
-      evaluator->Evaluate(node->Player(), node->Opponent(), (Eval)alpha, (Eval) beta, 5 * n_descendants_solve, 240, n_threads, false);
-      auto result_ptr = evaluator->GetFirstPosition();
-      assert(result_ptr);
-      const auto& result = *result_ptr;
-      auto lower = result.Lower();
-      auto upper = result.Upper();
-      node->SetLower(lower);
-      node->SetUpper(upper);
-      n_visited += result.GetNVisited();
-      solved = upper <= alpha || lower == upper || lower >= beta;
-      if (solved) {
-        std::cout << "Solved: " << (int) result.Lower() << " <= eval <= " << (int) result.Upper() << "\n";
-      } else {
-        std::cout << "Did not solve it in time\n";
+      if (expansions.empty()) {
+        std::cout << (book.Get(Board(start_line))->IsSolved() ? "Solved the position!\n" : "No line to expand\n");
+        break;
       }
-    } else {
-      std::cout << "Too early to solve\n";
     }
-    if (!solved) {
-      tree_node_supplier.Reset();
-      std::cout << "Adding children\n";
-      std::vector<Node> children;
-      int i = 0;
-      for (auto child_flip : GetUniqueNextBoardsWithPass(node->ToBoard())) {
-        auto child = child_flip.first;
-        auto evaluator = evaluators[++i].get();
-        evaluator->Evaluate(
-            child.Player(), child.Opponent(), -63, 63, n_descendants_children / 100, 300, n_threads);
-        auto early_result = evaluator->GetFirstPosition();
-        assert(early_result);
-        // At least evaluate 10M nodes.
-        auto remaining_work = std::max((NVisited) 300000000, (NVisited) early_result->RemainingWork(alpha, beta));
-        evaluator->ContinueEvaluate(
-            std::min(n_descendants_children, (NVisited) remaining_work / 30), 300, n_threads);
-        auto result = evaluator->GetFirstPosition();
-        assert(result);
-        children.push_back(*result);
-        n_visited += result->GetNVisited();
+    // Waits for the first expansion that finishes.
+    auto finished = expansions.end();
+    while (finished == expansions.end()) {
+      for (auto expansion = expansions.begin(); expansion != expansions.end(); ++expansion) {
+        if (expansion->result.wait_for(std::chrono::milliseconds(10)) == std::future_status::ready) {
+          finished = expansion;
+          break;
+        }
       }
-      book.AddChildren(node->ToBoard(), children);
     }
-    leaf.Finalize(n_visited);
+    AddToBook(book, *finished, finished->result.get());
+    idle_expanders.push_back(finished->expander);
+    expansions.erase(finished);
+    ++n_expansions;
+    ++n_expansions_since_commit;
+
+    if (n_expansions_since_commit >= commit_every && expansions.empty()) {
+      book.Commit();
+      n_expansions_since_commit = 0;
+      double hours = total_time.Get() / 3600;
+      std::cout << "Expansions:            " << n_expansions << "\n";
+      std::cout << "Committed nodes / sec: " << PrettyPrintDouble(book.LastCommitSize() / book.LastCommitSeconds()) << "\n";
+      std::cout << "Book nodes / hour:     " << PrettyPrintDouble((book.Size() - initial_book_size) / hours) << "\n";
+      std::cout << "\n";
+    }
+  }
+  if (n_expansions_since_commit > 0) {
     book.Commit();
-    double time = t.Get();
-    std::cout << "Position:              " << PrettyPrintDouble((double) n_visited) << "\n";
-    std::cout << "Time:                  " << PrettyPrintDouble(time) << " sec\n";
-    std::cout << "Positions / sec:       " << PrettyPrintDouble((double)n_visited / time) << "\n";
-    std::cout << "\n";
   }
 }
@@ -195,6 +195,7 @@ int main(int argc, char* argv[]) {
     std::cout << "Position:              " << PrettyPrintDouble((double) n_visited) << "\n";
     std::cout << "Time:                  " << PrettyPrintDouble(time) << " sec\n";
     std::cout << "Positions / sec:       " << PrettyPrintDouble(n_visited / time) << "\n";
+    std::cout << "Committed nodes / sec: " << PrettyPrintDouble(book.LastCommitSize() / book.LastCommitSeconds()) << "\n";
     std::cout << "\n";
   }
 }
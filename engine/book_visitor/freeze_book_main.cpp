@@ -0,0 +1,57 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Exports a book to the frozen format, for distribution. The frozen book is
+// read-only, and it is opened with Book(target_path) like the original.
+//
+// Usage:
+// ./build/book_visitor/freeze_book_main --source_path=assets/book \
+//     --target_path=assets/book_frozen
+
+#include <iostream>
+
+#include "../book/book.h"
+#include "../utils/files.h"
+#include "../utils/misc.h"
+#include "../utils/parse_flags.h"
+
+uint64_t FolderSize(const std::string& folder) {
+  uint64_t result = 0;
+  for (const std::string& file : GetAllFiles(folder, true, false)) {
+    result += fs::file_size(file);
+  }
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  ParseFlags parse_flags(argc, argv);
+  std::string source_path = parse_flags.GetFlag("source_path");
+  std::string target_path = parse_flags.GetFlag("target_path");
+
+  ElapsedTime time;
+  Book<> source(source_path);
+  if (!source.Freeze(target_path)) {
+    return 1;
+  }
+  Book<> target(target_path);
+  if (target.Size() != source.Size() || target.Roots() != source.Roots()) {
+    std::cout << "The frozen book has " << target.Size() << " positions instead of " << source.Size() << "\n";
+    return 1;
+  }
+  std::cout << "Froze " << source.Size() << " positions in " << time.Get() << " sec\n";
+  std::cout << "Size: " << FolderSize(source_path) << " bytes -> " << FolderSize(target_path) << " bytes\n";
+  return 0;
+}
@@ -61,6 +61,10 @@ class BookVisitorTopKValue : public BookVisitorWithProgress<kBookVersion> {
     if (value > kth_value_estimate_) {
       return false;
     }
+    return AddValue(value);
+  }
+
+  bool AddValue(double value) {
     if (lowest_k_values_.size() >= k_ && value > lowest_k_values_.top()) {
       return false;
     }
@@ -78,6 +82,20 @@ class BookVisitorTopKValue : public BookVisitorWithProgress<kBookVersion> {
     return VisitNode();
   }
 
+  std::unique_ptr<BookVisitor> Clone() const override {
+    auto clone = std::make_unique<BookVisitorTopKValue>(*this);
+    clone->lowest_k_values_ = std::priority_queue<double>();
+    return clone;
+  }
+
+  void Merge(const BookVisitor& other) override {
+    std::priority_queue<double> values = static_cast<const BookVisitorTopKValue&>(other).lowest_k_values_;
+    while (!values.empty()) {
+      AddValue(values.top());
+      values.pop();
+    }
+  }
+
  private:
   int k_;
   double kth_value_estimate_;
@@ -131,11 +149,12 @@ int main(int argc, char* argv[]) {
   double kth_value_estimate = parse_flags.GetDoubleFlag("kth_value_estimate");
   std::string target_small = parse_flags.GetFlag("target_small_path");
   std::string target_medium = parse_flags.GetFlag("target_medium_path");
+  int n_threads = parse_flags.GetIntFlagOrDefault("n_threads", (int) std::thread::hardware_concurrency());
 
   Book source(source_path);
 
   BookVisitorTopKValue top_k(source, 200001, kth_value_estimate);
-  top_k.VisitString("");
+  top_k.VisitStringParallel("", n_threads);
   std::vector<double> top_k_values = top_k.Values();
 
   std::cout << "Got " << top_k_values.size() << " nodes:\n";
@@ -18,11 +18,87 @@
 #define BOOK_VISITOR_VISITOR_H
 
 #include<string.h>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
 
 #include "../book/book.h"
 #include "../board/get_moves.h"
 #include "../board/sequence.h"
 
+// A subtree to visit in a parallel visit, with the state of the visitor at its
+// root.
+struct BookVisitorTask {
+  Board board;
+  Sequence sequence;
+  int depth;
+  // The evaluations at depth 0, ..., depth - 1.
+  std::vector<double> evaluations;
+};
+
+// Schedules the subtrees of a parallel visit on n_threads threads. Each thread
+// pushes and pops subtrees at the back of its own queue (so that it visits
+// depth first), and a thread with an empty queue steals from the front of the
+// others, where the subtrees closest to the root are.
+class BookVisitorScheduler {
+ public:
+  explicit BookVisitorScheduler(int n_threads) : queues_(n_threads), queued_(0), pending_(0) {}
+
+  // Splits only if the queues are almost empty, so that most subtrees are
+  // visited recursively by the thread that found them.
+  bool ShouldSplit() const { return queued_ < 2 * (int) queues_.size(); }
+
+  void Push(int thread, BookVisitorTask task) {
+    ++pending_;
+    std::lock_guard<std::mutex> guard(queues_[thread].mutex);
+    queues_[thread].tasks.push_back(std::move(task));
+    ++queued_;
+  }
+
+  // Returns false when all the tasks are done. Otherwise, the caller must call
+  // Done() after visiting the task.
+  bool Pop(int thread, BookVisitorTask* task) {
+    while (true) {
+      for (int i = 0; i < queues_.size(); ++i) {
+        Queue& queue = queues_[(thread + i) % queues_.size()];
+        std::lock_guard<std::mutex> guard(queue.mutex);
+        if (queue.tasks.empty()) {
+          continue;
+        }
+        if (i == 0) {
+          *task = std::move(queue.tasks.back());
+          queue.tasks.pop_back();
+        } else {
+          *task = std::move(queue.tasks.front());
+          queue.tasks.pop_front();
+        }
+        --queued_;
+        return true;
+      }
+      // The tasks still running can push new tasks.
+      if (pending_ == 0) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void Done() { --pending_; }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<BookVisitorTask> tasks;
+  };
+  std::vector<Queue> queues_;
+  std::atomic_int queued_;
+  // Tasks pushed and not done yet.
+  std::atomic_int pending_;
+};
+
 template<int version = kBookVersion>
 class BookVisitor {
  public:
@@ -35,6 +111,8 @@ class BookVisitor {
     }
   }
 
+  virtual ~BookVisitor() {}
+
   virtual void VisitAll() {
     for (const Board& root : book_.Roots()) {
       sequence_ = Sequence();
@@ -51,6 +129,40 @@ class BookVisitor {
     Visit(sequence.ToBoard());
   }
 
+  void VisitStringParallel(const std::string& sequence, int n_threads) {
+    VisitSequenceParallel(Sequence(sequence), n_threads);
+  }
+
+  // Visits the subtree of sequence with n_threads copies of this visitor (see
+  // Clone()), then merges their results into this one. Visitors that do not
+  // implement Clone() visit sequentially.
+  virtual void VisitSequenceParallel(const Sequence& sequence, int n_threads) {
+    // std::thread::hardware_concurrency() can return 0.
+    n_threads = std::max(1, n_threads);
+    std::vector<std::unique_ptr<BookVisitor>> workers;
+    for (int i = 0; i < n_threads; ++i) {
+      workers.push_back(Clone());
+      if (!workers.back()) {
+        VisitSequence(sequence);
+        return;
+      }
+    }
+    BookVisitorScheduler scheduler(n_threads);
+    scheduler.Push(0, BookVisitorTask {sequence.ToBoard(), sequence, 0, {}});
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < n_threads; ++i) {
+      futures.push_back(std::async(std::launch::async, [&workers, &scheduler, i]() {
+        workers[i]->VisitTasks(&scheduler, i);
+      }));
+    }
+    for (auto& future : futures) {
+      future.get();
+    }
+    for (const auto& worker : workers) {
+      Merge(*worker);
+    }
+  }
+
   virtual void Visit(const Board& board) {
     std::unique_ptr<Node> node = book_.Get(board);
     assert(node);
@@ -63,19 +175,28 @@ class BookVisitor {
       return;
     }
     auto flips = GetAllMovesWithPass(board.Player(), board.Opponent());
-    std::unordered_set<Board> seen_boards;
+    // There are few children: a linear scan is faster than a hash set.
+    std::vector<Board> seen_boards;
     seen_boards.reserve(flips.size());
     for (const BitPattern flip : flips) {
       Board child = board.Next(flip);
-      if (!seen_boards.insert(child.Unique()).second) {
+      Board unique = child.Unique();
+      if (std::find(seen_boards.begin(), seen_boards.end(), unique) != seen_boards.end()) {
         continue;
       }
+      seen_boards.push_back(unique);
       Square move = (Square) __builtin_ctzll(SquareFromFlip(flip, board.Player(), board.Opponent()));
       if (flip != 0) {
         sequence_.AddMove(move);
       }
       ++depth_;
-      Visit(child);
+      if (scheduler_ != nullptr && scheduler_->ShouldSplit()) {
+        scheduler_->Push(thread_, BookVisitorTask {
+            child, sequence_, depth_,
+            std::vector<double>(evaluations_at_depth_, evaluations_at_depth_ + depth_)});
+      } else {
+        Visit(child);
+      }
       --depth_;
       if (flip != 0) {
         sequence_.RemoveLastMove();
@@ -113,6 +234,54 @@ class BookVisitor {
   virtual void VisitLeaf(Node& node) {};
   virtual bool PreVisitInternalNode(Node& node) { return true; };
   virtual void PostVisitInternalNode(Node& node) {};
+
+  // To support parallel visits, Clone() returns a visitor with the same
+  // parameters and no results, and Merge() adds the results of a clone to this
+  // visitor. Each clone runs on its own thread, and visits the subtrees in any
+  // order: the children of a node might be visited after its
+  // PostVisitInternalNode(), by another clone. Visitors that need the results
+  // of the children in PostVisitInternalNode() (or that modify a book) must
+  // not implement Clone().
+  virtual std::unique_ptr<BookVisitor> Clone() const { return nullptr; }
+  virtual void Merge(const BookVisitor& other) {}
+
+ private:
+  // Set only while visiting the tasks of a parallel visit.
+  BookVisitorScheduler* scheduler_ = nullptr;
+  int thread_ = 0;
+
+  void VisitTasks(BookVisitorScheduler* scheduler, int thread) {
+    scheduler_ = scheduler;
+    thread_ = thread;
+    BookVisitorTask task;
+    while (scheduler->Pop(thread, &task)) {
+      sequence_ = task.sequence;
+      depth_ = task.depth;
+      std::copy(task.evaluations.begin(), task.evaluations.end(), evaluations_at_depth_);
+      Visit(task.board);
+      scheduler->Done();
+    }
+    scheduler_ = nullptr;
+  }
+};
+
+// A set of boards that many threads can update at the same time.
+class ConcurrentBoardSet {
+ public:
+  // Returns true if the board was not in the set.
+  bool Insert(const Board& b) {
+    Shard& shard = shards_[std::hash<Board>()(b) >> 26];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    return shard.boards.insert(b).second;
+  }
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_set<Board> boards;
+  };
+  // The shard is given by the top 6 bits of the 32-bit hash.
+  Shard shards_[64];
 };
 
 template<int version = kBookVersion>
@@ -122,17 +291,20 @@ class BookVisitorNoTranspositions : public BookVisitor<version> {
   using typename BookVisitor::Book;
   using typename BookVisitor::BookNode;
 
-  BookVisitorNoTranspositions(const Book& book) : BookVisitor(book) {}
+  BookVisitorNoTranspositions(const Book& book) :
+      BookVisitor(book), visited_(std::make_shared<ConcurrentBoardSet>()) {}
 
   virtual void Visit(const Board& board) override {
-    if (!visited_.insert(board.Unique()).second) {
+    if (!visited_->Insert(board.Unique())) {
       return;
     }
     BookVisitor::Visit(board);
   }
 
  private:
-  std::unordered_set<Board> visited_;
+  // Shared with the copies of this visitor, so that each board is visited once
+  // also in parallel visits.
+  std::shared_ptr<ConcurrentBoardSet> visited_;
 };
 
 template<int version = kBookVersion>
@@ -166,22 +338,42 @@ class BookVisitorWithProgress : public BookVisitor<kBookVersion> {
     }
     BookVisitor::Visit(board);
     // TODO: Avoid this Get.
-    visited_at_depth_[depth_] += book_.Get(board)->GetNVisited();
-    visited_at_depth_[depth_ + 1] = 0;
+    std::unique_ptr<Node> node = book_.Get(board);
+    if (visited_leaves_) {
+      if (node->IsLeaf()) {
+        *visited_leaves_ += node->GetNVisited();
+      }
+    } else {
+      visited_at_depth_[depth_] += node->GetNVisited();
+      visited_at_depth_[depth_ + 1] = 0;
+    }
     evaluations_at_depth_[depth_] = 0;
   }
 
   virtual void VisitSequence(const Sequence& sequence) override {
     to_be_visited_ = book_.Get(sequence.ToBoard())->GetNVisited();
+    visited_leaves_ = nullptr;
     sequence_ = sequence;
     Visit(sequence.ToBoard());
   }
 
+  // The clones visit disjoint subtrees starting at any depth, so they cannot
+  // use visited_at_depth_: they share the sum of the descendants of the leaves
+  // visited so far (this ignores the work done on the internal nodes).
+  virtual void VisitSequenceParallel(const Sequence& sequence, int n_threads) override {
+    to_be_visited_ = book_.Get(sequence.ToBoard())->GetNVisited();
+    visited_leaves_ = std::make_shared<std::atomic<NVisited>>(0);
+    BookVisitor::VisitSequenceParallel(sequence, n_threads);
+  }
+
  protected:
   using BookVisitor::sequence_;
   using BookVisitor::depth_;
 
   NVisited GetVisited() {
+    if (visited_leaves_) {
+      return *visited_leaves_;
+    }
     NVisited visited = 0;
     for (int i = 0; i < 120; ++i) {
       visited += visited_at_depth_[i];
@@ -195,6 +387,8 @@ class BookVisitorWithProgress : public BookVisitor<kBookVersion> {
   NVisited actually_visited_;
   NVisited visiting_at_depth_[120];
   NVisited visited_at_depth_[120];
+  // Set by a parallel visit, and shared with the clones.
+  std::shared_ptr<std::atomic<NVisited>> visited_leaves_;
 };
 
 #endif  // BOOK_VISITOR_VISITOR_H
\ No newline at end of file
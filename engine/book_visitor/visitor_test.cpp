@@ -230,4 +230,116 @@ TEST(BookVisitor, VisitAll) {
       GetVisitedNode(book, "e6f4", "", LAST_VISIT),
       GetVisitedNode(book, "e6f6", "", LEAF)
   ));
-}
\ No newline at end of file
+}
+
+// Collects the sequences of the visited nodes, with their errors. Supports
+// parallel visits.
+template<class Base>
+class BookVisitorToSequences : public Base {
+ public:
+  typedef BookVisitor<kBookVersion> BookVisitor;
+  using Base::Base;
+
+  std::vector<std::string> Get() const {
+    std::vector<std::string> result = sequences_;
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+ protected:
+  void VisitLeaf(Node& node) override { AddNode(); }
+  bool PreVisitInternalNode(Node& node) override {
+    AddNode();
+    return true;
+  }
+
+  std::unique_ptr<BookVisitor> Clone() const override {
+    auto clone = std::make_unique<BookVisitorToSequences>(*this);
+    clone->sequences_.clear();
+    return clone;
+  }
+
+  void Merge(const BookVisitor& other) override {
+    const auto& other_sequences = static_cast<const BookVisitorToSequences&>(other).sequences_;
+    sequences_.insert(sequences_.end(), other_sequences.begin(), other_sequences.end());
+  }
+
+ private:
+  std::vector<std::string> sequences_;
+
+  void AddNode() {
+    auto [error_black, error_white] = this->GetErrors();
+    sequences_.push_back(
+        this->sequence_.ToString() + " " + std::to_string(error_black) + " " + std::to_string(error_white));
+  }
+};
+
+Book<> BookForParallelVisit() {
+  Book<> book = BookWithPositions({"e6", "e6f4", "e6f4c3", "e6f4d3", "e6f4c3c4", "e6f4d3c4", "e6f4c3c4d3"});
+  book.Commit();
+  return book;
+}
+
+TEST(BookVisitor, ParallelSameAsSequential) {
+  Book<> book = BookForParallelVisit();
+  BookVisitorToSequences<BookVisitor<kBookVersion>> sequential(book);
+  sequential.VisitString("e6");
+  ASSERT_GT(sequential.Get().size(), 30);
+
+  for (int n_threads : {1, 2, 4, 8}) {
+    BookVisitorToSequences<BookVisitor<kBookVersion>> parallel(book);
+    parallel.VisitStringParallel("e6", n_threads);
+    EXPECT_EQ(parallel.Get(), sequential.Get());
+  }
+}
+
+TEST(BookVisitor, ParallelNoTranspositions) {
+  Book<> book = BookForParallelVisit();
+  BookVisitorToSequences<BookVisitorNoTranspositions<kBookVersion>> sequential(book);
+  sequential.VisitString("e6");
+
+  for (int n_threads : {1, 2, 4, 8}) {
+    BookVisitorToSequences<BookVisitorNoTranspositions<kBookVersion>> parallel(book);
+    parallel.VisitStringParallel("e6", n_threads);
+    // The transpositions can be visited from a different sequence.
+    EXPECT_EQ(parallel.Get().size(), sequential.Get().size());
+  }
+}
+
+TEST(BookVisitor, ParallelFallsBackToSequential) {
+  Book<> book = BookForParallelVisit();
+  BookVisitorToVectorNoTransposition visitor(book);
+  visitor.VisitStringParallel("e6", 4);
+  CheckVectorHasRightOrder(visitor.Get());
+}
+
+class BookVisitorProgressToSequences : public BookVisitorToSequences<BookVisitorWithProgress<kBookVersion>> {
+ public:
+  using BookVisitorToSequences::BookVisitorToSequences;
+
+  NVisited Visited() { return GetVisited(); }
+};
+
+TEST(BookVisitor, ParallelProgress) {
+  Book<> book = BookWithPositions({"", "e6", "e6f4", "e6f4c3", "e6f4d3", "e6f4c3c4", "e6f4d3c4", "e6f4c3c4d3"});
+  book.Commit();
+  BookVisitorToSequences<BookVisitor<kBookVersion>> sequential(book);
+  sequential.VisitString("e6");
+  NVisited expected = 0;
+  for (const std::string& line : sequential.Get()) {
+    auto node = book.Get(Board(line.substr(0, line.find(' '))));
+    if (node->IsLeaf()) {
+      expected += node->GetNVisited();
+    }
+  }
+  ASSERT_GT(expected, 0);
+
+  // With 0 threads (e.g. from std::thread::hardware_concurrency()), it visits
+  // with 1 thread.
+  for (int n_threads : {0, 1, 2, 4, 8}) {
+    BookVisitorProgressToSequences parallel(book);
+    parallel.VisitStringParallel("e6", n_threads);
+    EXPECT_EQ(parallel.Get(), sequential.Get());
+    EXPECT_EQ(parallel.Visited(), expected);
+  }
+}
@@ -84,7 +84,8 @@ enum StatsType {
   NEXT_POSITION_FAIL = 7,
   NEXT_POSITION_SUCCESS = 8,
   SOLVED_TOO_EARLY = 9,
-  NO_TYPE = 10
+  UPDATE_FATHER = 10,
+  NO_TYPE = 11
 };
 
 class Stats {
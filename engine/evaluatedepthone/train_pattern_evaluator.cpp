@@ -20,44 +20,32 @@
 #include "train_pattern_evaluator.h"
 
 
-TrainingBoard::TrainingBoard(
+void TrainingSet::Reserve(int num_boards) {
+  features_.reserve((size_t) num_boards * num_features_);
+  evals_.reserve(num_boards);
+}
+
+int TrainingSet::Add(const std::vector<FeatureValue>& features, int eval) {
+  assert(features.size() == num_features_);
+  features_.insert(features_.end(), features.begin(), features.end());
+  evals_.push_back(eval);
+  return Size() - 1;
+}
+
+int TrainingSet::Add(
     const EvaluatedBoard& b,
     const std::vector <std::vector<
         FeatureValue>>& feature_value_to_canonical) {
+  assert(num_features_ == kNumFeatures);
   PatternEvaluator p(nullptr);
-  eval_ = b.GetEval();
   p.Setup(b.GetPlayer(), b.GetOpponent());
   for (int i = 0; i < kNumFeatures; ++i) {
     features_.push_back(
         feature_value_to_canonical[kFeatures.canonical_rotation[i]]
                                   [p.GetFeature(i)]);
   }
-}
-
-bool TrainingBoard::operator==(const TrainingBoard& other) const {
-  if (Eval() != other.Eval()) {
-    return false;
-  }
-  const auto& features = Features();
-  const auto& other_features = other.Features();
-  if (features.size() != other_features.size()) {
-    return false;
-  }
-  for (int i = 0; i < features.size(); ++i) {
-    if (features[i] != other_features[i]) {
-      return false;
-    }
-  }
-  return true;
-}
-
-std::size_t std::hash<TrainingBoard>::operator()(
-    const TrainingBoard& f) const noexcept {
-  std::size_t result = std::hash<int>{}(f.Eval());
-  for (const FeatureValue& feature : f.Features()) {
-    result = result ^ std::hash<Pattern>{}(feature);
-  }
-  return result;
+  evals_.push_back(b.GetEval());
+  return Size() - 1;
 }
 
 void TrainingFeature::UpdateValue(float error, float learning_rate, float lambda) {
@@ -83,10 +71,9 @@ CategoricalRegression::CategoricalRegression(
   }
 }
 
-float CategoricalRegression::Eval(const TrainingBoard& b) {
-  const std::vector<FeatureValue>& features = b.Features();
+float CategoricalRegression::Eval(const FeatureValue* features) const {
   float result = 0;
-  for (int i = 0; i < features.size(); ++i) {
+  for (int i = 0; i < max_feature_value_.size(); ++i) {
     assert (features[i] <= max_feature_value_[i]);
     result += features_[canonical_rotation_[i]][features[i]].GetValue();
   }
@@ -94,30 +81,58 @@ float CategoricalRegression::Eval(const TrainingBoard& b) {
   return result;
 }
 
-float CategoricalRegression::Error(const TrainingBoard& b) {
-  return (float) b.Eval() - Eval(b);
+float CategoricalRegression::Error(const TrainingSet& set, int board) const {
+  return (float) set.Eval(board) - Eval(set.Features(board));
 }
 
 void CategoricalRegression::Train(
-    std::vector<const TrainingBoard*> training_set_,
-    float learning_rate, float lambda) {
-  auto rng = std::default_random_engine{};
-  std::shuffle(std::begin(training_set_), std::end(training_set_), rng);
-  for (const TrainingBoard* const b : training_set_) {
-    const std::vector<FeatureValue>& features = b->Features();
-    float error = Error(*b);
-    for (int f = 0; f < features.size(); ++f) {
+    const TrainingSet& set, std::vector<int> training_set,
+    float learning_rate, float lambda, int n_threads) {
+  if (n_threads <= 1) {
+    TrainThread(set, std::move(training_set), learning_rate, lambda, 0);
+    return;
+  }
+  std::vector<std::vector<int>> parts(n_threads);
+  for (int i = 0; i < n_threads; ++i) {
+    parts[i].reserve(training_set.size() / n_threads + 1);
+  }
+  for (int i = 0; i < training_set.size(); ++i) {
+    parts[i % n_threads].push_back(training_set[i]);
+  }
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < n_threads; ++i) {
+    futures.push_back(std::async(
+        std::launch::async, &CategoricalRegression::TrainThread, this,
+        std::cref(set), std::move(parts[i]), learning_rate, lambda, i));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+}
+
+void CategoricalRegression::TrainThread(
+    const TrainingSet& set, std::vector<int> training_set,
+    float learning_rate, float lambda, int seed) {
+  auto rng = std::default_random_engine(
+      std::default_random_engine::default_seed + seed);
+  std::shuffle(std::begin(training_set), std::end(training_set), rng);
+  int num_features = set.NumFeatures();
+  for (int b : training_set) {
+    const FeatureValue* features = set.Features(b);
+    float error = Error(set, b);
+    for (int f = 0; f < num_features; ++f) {
       features_[canonical_rotation_[f]][features[f]]
           .UpdateValue(error, learning_rate, lambda);
     }
   }
 }
 
-float CategoricalRegression::Test(const std::vector<const TrainingBoard*>& test_set) {
+float CategoricalRegression::Test(
+    const TrainingSet& set, const std::vector<int>& test_set) const {
   double total_error = 0;
 
-  for (const TrainingBoard* b : test_set) {
-    float error = Error(*b);
+  for (int b : test_set) {
+    float error = Error(set, b);
     total_error += error * error;
   }
   return (float) sqrt(total_error / (double) test_set.size());
@@ -133,9 +148,12 @@ void CategoricalRegression::Round() {
 
 CategoricalRegressions::CategoricalRegressions(
     int num_splits,
-    std::vector<EvaluatedBoard> test_set,
-    int max_num_boards) :
-    max_num_boards(max_num_boards) {
+    EvaluatedBoards test_set,
+    int max_num_boards,
+    int n_threads) :
+    training_set_(kNumFeatures),
+    max_num_boards(max_num_boards),
+    n_threads_(std::max(1, n_threads)) {
   std::vector<FeatureValue> max_feature_value(
       std::begin(kFeatures.max_feature_value),
       std::end(kFeatures.max_feature_value));
@@ -144,30 +162,23 @@ CategoricalRegressions::CategoricalRegressions(
       std::end(kFeatures.canonical_rotation));
   feature_value_to_canonical_ = FeatureValueToCanonical();
   test_set_ = std::move(test_set);
-  training_boards_ =
-      (TrainingBoard*) malloc(max_num_boards * sizeof(TrainingBoard));
+  training_set_.Reserve(max_num_boards);
   regressions_ =
       std::vector<CategoricalRegression>(num_splits, CategoricalRegression(
           max_feature_value, canonical_rotation));
 }
 
-CategoricalRegressions::~CategoricalRegressions() {
-  free(training_boards_);
-}
-
 void CategoricalRegressions::Split(int new_num_splits) {
   assert (regressions_.size() == 1);
   regressions_ =
       std::vector<CategoricalRegression>(new_num_splits, regressions_[0]);
 }
 
-void CategoricalRegressions::Train(const std::vector<EvaluatedBoard>& boards,
+void CategoricalRegressions::Train(const EvaluatedBoards& boards,
                                    int distance,
                                    std::vector<float> learning_rates) {
-  std::vector<std::vector<const TrainingBoard*>>
-      training = BuildTrainSet(boards, distance);
-  std::vector<std::vector<const TrainingBoard*>>
-      test = BuildTrainSet(test_set_, distance);
+  std::vector<std::vector<int>> training = BuildTrainSet(boards, distance);
+  std::vector<std::vector<int>> test = BuildTrainSet(test_set_, distance);
   if (!boards.empty()) {
     std::cout << elapsed_time_.Get() << ": Prepared for training on "
               << boards.size() << " examples, distance " << distance << "\n";
@@ -212,53 +223,59 @@ void CategoricalRegressions::Save(const std::string& filepath) const {
 }
 
 std::string CategoricalRegressions::Step(
-    const std::vector<std::vector<const TrainingBoard*>>& train,
-    const std::vector<std::vector<const TrainingBoard*>>& test,
+    const std::vector<std::vector<int>>& train,
+    const std::vector<std::vector<int>>& test,
     float learning_rate) {
+  double start = elapsed_time_.Get();
+  int num_splits = (int) regressions_.size();
+  // Splits are independent: train them concurrently, and give each split an
+  // equal share of the remaining threads for Hogwild updates.
+  int threads_per_split = std::max(1, n_threads_ / num_splits);
+  auto launch = n_threads_ > 1 ? std::launch::async : std::launch::deferred;
+  std::vector<std::future<float>> errors;
+  for (int i = 0; i < num_splits; ++i) {
+    errors.push_back(std::async(launch, [&, i]() {
+      regressions_[i].Train(
+          training_set_, train[i], learning_rate, 0, threads_per_split);
+      return regressions_[i].Test(training_set_, test[i]);
+    }));
+  }
   double total_error = 0;
   double total_examples = 0;
   std::stringstream result;
   result << "    Errors: ";
-  for (int i = 0; i < regressions_.size(); ++i) {
-    regressions_[i].Train(train[i], learning_rate, 0);
-    float error = regressions_[i].Test(test[i]);
+  for (int i = 0; i < num_splits; ++i) {
+    float error = errors[i].get();
     total_error += (error * error) * (float) test[i].size();
     total_examples += (double) test[i].size();
     result << error << " ";
   }
   result << "\n    Total: " << sqrt(total_error / total_examples);
+  result << "\n    Time: " << elapsed_time_.Get() - start << "s with "
+         << n_threads_ << " threads";
   return result.str();
 }
 
-std::vector<std::vector<const TrainingBoard*>>
-    CategoricalRegressions::BuildTrainSet(
-        const std::vector<EvaluatedBoard>& boards,
-        int distance) {
+std::vector<std::vector<int>> CategoricalRegressions::BuildTrainSet(
+    const EvaluatedBoards& boards,
+    int distance) {
   int num_splits = (int) regressions_.size();
-  std::vector<std::vector<int>> board_to_index(num_splits);
-  std::vector<std::vector<const TrainingBoard*>> result(num_splits);
+  std::vector<std::vector<int>> result(num_splits);
 
   for (const EvaluatedBoard& b : boards) {
-    int size = (int) board_to_index_.size();
+    int size = training_set_.Size();
     auto value = board_to_index_.insert(std::make_pair(b, size));
     int current_board = value.first->second;
     assert((current_board == size) == value.second);
     if (current_board == size) {
       assert(current_board < max_num_boards);
-      training_boards_[current_board] =
-          TrainingBoard(b, feature_value_to_canonical_);
+      training_set_.Add(b, feature_value_to_canonical_);
     }
     int exact_value = GetSplit(b.Empties(), num_splits);
     for (int i = std::max(0, exact_value - distance);
-         i <= std::min((int) board_to_index.size() - 1, exact_value + distance);
+         i <= std::min(num_splits - 1, exact_value + distance);
          ++i) {
-      board_to_index[i].push_back(current_board);
-    }
-  }
-  for (int i = 0; i < board_to_index.size(); ++i) {
-    result[i].reserve(board_to_index[i].size());
-    for (int j = 0; j < board_to_index[i].size(); ++j) {
-      result[i].push_back(&(training_boards_[board_to_index[i][j]]));
+      result[i].push_back(current_board);
     }
   }
   return result;
@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <cassert>
 #include <fstream>
+#include <future>
 #include <memory>
 #include <random>
 #include <set>
@@ -25,30 +26,35 @@
 #include "../utils/load_training_set.h"
 #include "../utils/misc.h"
 
-class TrainingBoard {
+// The boards used for training, stored as a row-major matrix of features
+// (one row of NumFeatures() values per board) plus a column of evals. Boards
+// are referred to by their row index.
+class TrainingSet {
  public:
-  TrainingBoard() {}
-  TrainingBoard(std::vector<FeatureValue> features, int eval) :
-      features_(features), eval_(eval) {}
+  explicit TrainingSet(int num_features) : num_features_(num_features) {}
 
-  TrainingBoard(
+  void Reserve(int num_boards);
+
+  int Add(const std::vector<FeatureValue>& features, int eval);
+
+  int Add(
       const EvaluatedBoard& b,
       const std::vector<std::vector<FeatureValue>>& feature_value_to_canonical);
 
-  int Eval() const { return eval_; }
+  int Size() const { return (int) evals_.size(); }
 
-  const std::vector<FeatureValue>& Features() const { return features_; }
+  int NumFeatures() const { return num_features_; }
 
-  bool operator==(const TrainingBoard& other) const;
+  int Eval(int board) const { return evals_[board]; }
+
+  const FeatureValue* Features(int board) const {
+    return &features_[(size_t) board * num_features_];
+  }
 
  private:
+  int num_features_;
   std::vector<FeatureValue> features_;
-  int eval_;
-};
-
-template<>
-struct std::hash<TrainingBoard> {
-  std::size_t operator()(const TrainingBoard& f) const noexcept;
+  std::vector<int> evals_;
 };
 
 class TrainingFeature {
@@ -80,13 +86,18 @@ class CategoricalRegression {
   CategoricalRegression(std::vector<FeatureValue> max_feature_value,
                         std::vector<int> canonical_rotation);
 
-  float Eval(const TrainingBoard& b);
+  float Eval(const FeatureValue* features) const;
 
-  float Error(const TrainingBoard& b);
+  float Error(const TrainingSet& set, int board) const;
 
-  void Train(std::vector<const TrainingBoard*> training_set_, float learning_rate, float lambda);
+  // Runs one SGD epoch on training_set. With n_threads > 1, the set is split
+  // across threads that update the shared features without locks (Hogwild).
+  // Thread i shuffles its own part with seed default_seed + i, so the result
+  // only depends on n_threads (and on scheduling when n_threads > 1).
+  void Train(const TrainingSet& set, std::vector<int> training_set,
+             float learning_rate, float lambda, int n_threads = 1);
 
-  float Test(const std::vector<const TrainingBoard*>& test_set);
+  float Test(const TrainingSet& set, const std::vector<int>& test_set) const;
 
   void Round();
 
@@ -95,6 +106,9 @@ class CategoricalRegression {
   }
 
  private:
+  void TrainThread(const TrainingSet& set, std::vector<int> training_set,
+                   float learning_rate, float lambda, int seed);
+
   std::vector<FeatureValue> max_feature_value_;
   std::vector<int> canonical_rotation_;
   std::vector<std::vector<TrainingFeature>> features_;
@@ -105,14 +119,13 @@ class CategoricalRegressions {
  public:
   CategoricalRegressions(
       int num_splits,
-      std::vector<EvaluatedBoard> test_set,
-      int max_num_boards);
-
-  ~CategoricalRegressions();
+      EvaluatedBoards test_set,
+      int max_num_boards,
+      int n_threads = 1);
 
   void Split(int new_num_splits);
 
-  void Train(const std::vector<EvaluatedBoard>& boards, int distance,
+  void Train(const EvaluatedBoards& boards, int distance,
              std::vector<float> learning_rates);
 
   void Round();
@@ -120,12 +133,13 @@ class CategoricalRegressions {
   void Save(const std::string& filepath) const;
 
  private:
-  std::string Step(const std::vector<std::vector<const TrainingBoard*>>& train,
-                   const std::vector<std::vector<const TrainingBoard*>>& test,
+  std::string Step(const std::vector<std::vector<int>>& train,
+                   const std::vector<std::vector<int>>& test,
                    float learning_rate);
 
-  std::vector<std::vector<const TrainingBoard*>> BuildTrainSet(
-      const std::vector<EvaluatedBoard>& boards,
+  // For each split, the rows of training_set_ to train on.
+  std::vector<std::vector<int>> BuildTrainSet(
+      const EvaluatedBoards& boards,
       int distance);
 
   static std::vector<FeatureValue> FeatureValueToCanonical(int i);
@@ -134,10 +148,11 @@ class CategoricalRegressions {
 
   std::vector<CategoricalRegression> regressions_;
   std::unordered_map<EvaluatedBoard, int> board_to_index_;
-  TrainingBoard* training_boards_;
+  TrainingSet training_set_;
   int max_num_boards;
+  int n_threads_;
   std::vector<std::vector<FeatureValue>> feature_value_to_canonical_;
-  std::vector<EvaluatedBoard> test_set_;
+  EvaluatedBoards test_set_;
   ElapsedTime elapsed_time_;
 
 };
\ No newline at end of file
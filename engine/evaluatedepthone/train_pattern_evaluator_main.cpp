@@ -14,23 +14,28 @@
  * limitations under the License.
  */
 
+#include <thread>
 #include <unordered_map>
 
 #include "pattern_evaluator.h"
 #include "train_pattern_evaluator.h"
 #include "../utils/load_training_set.h"
+#include "../utils/parse_flags.h"
 
-int main() {
+int main(int argc, char* argv[]) {
+  ParseFlags parse_flags(argc, argv);
+  // Use --n_threads=1 to reproduce the single-threaded trainer.
+  int n_threads = parse_flags.GetIntFlagOrDefault("n_threads", (int) std::thread::hardware_concurrency());
 //  auto start = std::chrono::system_clock::now();
-  std::vector<EvaluatedBoard> full_train_board = load_hard_set(184);
-  std::vector<EvaluatedBoard> train_board = load_train_set();
-  full_train_board.insert(full_train_board.end(), train_board.begin(), train_board.end());
-//  std::vector<EvaluatedBoard> full_train_board = load_set(1987, 1991);
-//  std::vector<EvaluatedBoard> train_board = full_train_board;
-  std::vector<EvaluatedBoard> test_board = load_test_set();
+  EvaluatedBoards full_train_board = load_hard_set(184);
+  EvaluatedBoards train_board = load_train_set();
+  full_train_board.Append(train_board);
+//  EvaluatedBoards full_train_board = load_set(1987, 1991);
+//  EvaluatedBoards train_board = full_train_board;
+  EvaluatedBoards test_board = load_test_set();
   int num_splits = 10;
 
-  CategoricalRegressions trainer(1, test_board, (int) (full_train_board.size() + test_board.size()));
+  CategoricalRegressions trainer(1, test_board, (int) (full_train_board.size() + test_board.size()), n_threads);
 
   trainer.Train(full_train_board, 0, {0.005F, 0.002F, 0.001F, 0.0005F});
 
@@ -21,10 +21,11 @@
 
 using ::testing::ContainerEq;
 
-std::vector<TrainingBoard> TrainingSet(
+std::vector<int> AddRandomBoards(
+    TrainingSet& set,
     int size,
     const std::vector<FeatureValue>& max_feature_value) {
-  std::vector<TrainingBoard> result;
+  std::vector<int> result;
   for (int i = 0; i < size; ++i) {
     std::vector<FeatureValue> features(max_feature_value.size());
     int eval = 0;
@@ -32,47 +33,56 @@ std::vector<TrainingBoard> TrainingSet(
       features[f] = rand() % (max_feature_value[f] + 1);
       eval += features[f];
     }
-    result.push_back(TrainingBoard(features, eval));
+    result.push_back(set.Add(features, eval));
   }
   return result;
 }
 
+TEST(TrainPatternEvaluator, TrainingSet) {
+  TrainingSet set(3);
+  EXPECT_EQ(set.Add({0, 4, 2}, 6), 0);
+  EXPECT_EQ(set.Add({1, 3, 7}, -2), 1);
+  EXPECT_EQ(set.Size(), 2);
+  EXPECT_EQ(set.Eval(1), -2);
+  EXPECT_THAT(std::vector<FeatureValue>(set.Features(1), set.Features(1) + 3),
+              ContainerEq(std::vector<FeatureValue>({1, 3, 7})));
+}
+
 TEST(TrainPatternEvaluator, Simple) {
   std::vector<FeatureValue> max_feature_value = {1, 5, 7};
   std::vector<FeatureValue> canonical_rotation = {0, 1, 2};
-  std::vector<TrainingBoard> train_set_board = TrainingSet(1000, max_feature_value);
-  std::vector<TrainingBoard> test_set = TrainingSet(1000, max_feature_value);
-
-  std::vector<const TrainingBoard*> train_set;
-
-  for (TrainingBoard& b : train_set_board) {
-    train_set.push_back(&b);
-  }
+  TrainingSet set((int) max_feature_value.size());
+  std::vector<int> train_set = AddRandomBoards(set, 1000, max_feature_value);
+  std::vector<int> test_set = AddRandomBoards(set, 1000, max_feature_value);
 
   CategoricalRegression regression(max_feature_value, canonical_rotation);
-  regression.Train(train_set, 0.1, 0);
-//  EXPECT_FLOAT_EQ(regression.Eval(TrainingBoard({0, 4, 2}, 6)), 6);
-//  EXPECT_FLOAT_EQ(regression.Error(TrainingBoard({0, 4, 2}, 6)), 0);
-//  EXPECT_FLOAT_EQ(regression.Error(TrainingBoard({0, 4, 2}, 7)), 1);
-//  EXPECT_NEAR(regression.Test(test_set), 0, 1E-5);
+  regression.Train(set, train_set, 0.1, 0);
+//  EXPECT_NEAR(regression.Test(set, test_set), 0, 1E-5);
 }
 
 TEST(TrainPatternEvaluator, Save) {
   std::vector<FeatureValue> max_feature_value = {1, 5, 7};
   std::vector<FeatureValue> canonical_rotation = {0, 1, 2};
-  std::vector<TrainingBoard> train_set_board = TrainingSet(1000, max_feature_value);
-  std::vector<TrainingBoard> test_set = TrainingSet(1000, max_feature_value);
+  TrainingSet set((int) max_feature_value.size());
+  std::vector<int> train_set = AddRandomBoards(set, 1000, max_feature_value);
+  std::vector<int> test_set = AddRandomBoards(set, 1000, max_feature_value);
 
-  std::vector<const TrainingBoard*> train_set;
+  CategoricalRegression regression(max_feature_value, canonical_rotation);
+  regression.Train(set, train_set, 0.1, 0);
+//  EXPECT_NEAR(regression.Test(set, test_set), 0, 1E-5);
+}
 
-  for (TrainingBoard& b : train_set_board) {
-    train_set.push_back(&b);
-  }
+TEST(TrainPatternEvaluator, MultiThreaded) {
+  std::vector<FeatureValue> max_feature_value = {1, 5, 7};
+  std::vector<FeatureValue> canonical_rotation = {0, 1, 2};
+  TrainingSet set((int) max_feature_value.size());
+  std::vector<int> train_set = AddRandomBoards(set, 10000, max_feature_value);
+  std::vector<int> test_set = AddRandomBoards(set, 1000, max_feature_value);
 
   CategoricalRegression regression(max_feature_value, canonical_rotation);
-  regression.Train(train_set, 0.1, 0);
-//  EXPECT_FLOAT_EQ(regression.Eval(TrainingBoard({0, 4, 2}, 6)), 6);
-//  EXPECT_FLOAT_EQ(regression.Error(TrainingBoard({0, 4, 2}, 6)), 0);
-//  EXPECT_FLOAT_EQ(regression.Error(TrainingBoard({0, 4, 2}, 7)), 1);
-//  EXPECT_NEAR(regression.Test(test_set), 0, 1E-5);
+  float initial_error = regression.Test(set, test_set);
+  for (int i = 0; i < 5; ++i) {
+    regression.Train(set, train_set, 0.01, 0, 4);
+  }
+  EXPECT_LT(regression.Test(set, test_set), initial_error / 4);
 }
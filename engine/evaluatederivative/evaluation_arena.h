@@ -0,0 +1,140 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVALUATION_ARENA_H
+#define EVALUATION_ARENA_H
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "evaluation.h"
+
+// Bump allocator for the Evaluation arrays of the TreeNodes in a
+// TreeNodeSupplier. Memory is never freed until Reset(), which releases
+// everything at once (the chunks are kept and reused by the next search).
+//
+// Each thread grabs blocks of kBlockSize evaluations with one atomic add and
+// then allocates from its block without synchronization. The thread keeps one
+// block per arena (up to kLocalBlocks arenas), so that a thread working on
+// several arenas does not drop its block at every switch. Arrays are rounded up
+// to a power of two (see Capacity()), so a node that enlarges its range a few
+// times wastes at most as much as its final array.
+class EvaluationArena {
+ public:
+  static constexpr int kMaxArraySize = 64;
+  static constexpr int kBlockSize = 4096;
+  static constexpr int kLocalBlocks = 16;
+  static constexpr int kChunkBits = 20;
+  static constexpr uint64_t kChunkSize = 1ULL << kChunkBits;
+  static_assert(kChunkSize % kBlockSize == 0);
+  static_assert(kBlockSize >= kMaxArraySize);
+
+  explicit EvaluationArena(uint64_t max_evaluations) :
+      chunks_((max_evaluations + kChunkSize - 1) / kChunkSize),
+      next_(0),
+      epoch_(next_epoch_++),
+      local_block_index_(next_local_block_index_++ % kLocalBlocks) {}
+
+  EvaluationArena(const EvaluationArena&) = delete;
+
+  ~EvaluationArena() {
+    for (std::atomic<Evaluation*>& chunk : chunks_) {
+      free(chunk.load());
+    }
+  }
+
+  static int Capacity(int size) {
+    assert(size > 0 && size <= kMaxArraySize);
+    int capacity = 4;
+    while (capacity < size) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+
+  // Returns an array with space for `capacity` evaluations (a value returned by
+  // Capacity()), or nullptr if the arena is full.
+  Evaluation* Allocate(int capacity) {
+    LocalBlock& block = local_blocks_[local_block_index_];
+    uint64_t epoch = epoch_.load(std::memory_order_acquire);
+    if (block.epoch != epoch || block.next + capacity > block.end) {
+      uint64_t start = next_.fetch_add(kBlockSize, std::memory_order_relaxed);
+      block = LocalBlock {epoch, start, start + kBlockSize};
+    }
+    uint64_t offset = block.next;
+    block.next += capacity;
+    Evaluation* chunk = Chunk(offset >> kChunkBits);
+    return chunk == nullptr ? nullptr : chunk + (offset & (kChunkSize - 1));
+  }
+
+  // Invalidates all the arrays. Must not run concurrently with Allocate().
+  void Reset() {
+    next_ = 0;
+    epoch_ = next_epoch_++;
+  }
+
+  uint64_t UsedBytes() const {
+    return std::min(next_.load(), chunks_.size() * kChunkSize) * sizeof(Evaluation);
+  }
+
+  uint64_t AllocatedBytes() const {
+    uint64_t result = 0;
+    for (const std::atomic<Evaluation*>& chunk : chunks_) {
+      result += chunk.load() == nullptr ? 0 : kChunkSize * sizeof(Evaluation);
+    }
+    return result;
+  }
+
+ private:
+  struct LocalBlock {
+    uint64_t epoch;
+    uint64_t next;
+    uint64_t end;
+  };
+  // The epoch identifies both the arena and the Reset(), so that blocks
+  // grabbed from another arena sharing the slot (or before a Reset()) are
+  // never reused.
+  static inline std::atomic_uint64_t next_epoch_ = 1;
+  static inline std::atomic_uint64_t next_local_block_index_ = 0;
+  static inline thread_local LocalBlock local_blocks_[kLocalBlocks] = {};
+
+  std::vector<std::atomic<Evaluation*>> chunks_;
+  std::atomic_uint64_t next_;
+  std::atomic_uint64_t epoch_;
+  int local_block_index_;
+
+  Evaluation* Chunk(uint64_t index) {
+    if (index >= chunks_.size()) {
+      return nullptr;
+    }
+    Evaluation* chunk = chunks_[index].load(std::memory_order_acquire);
+    if (chunk != nullptr) {
+      return chunk;
+    }
+    Evaluation* new_chunk = (Evaluation*) malloc(kChunkSize * sizeof(Evaluation));
+    if (chunks_[index].compare_exchange_strong(chunk, new_chunk)) {
+      return new_chunk;
+    }
+    free(new_chunk);
+    return chunk;
+  }
+};
+
+#endif  // EVALUATION_ARENA_H
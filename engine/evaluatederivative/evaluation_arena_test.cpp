@@ -0,0 +1,82 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <future>
+#include <set>
+#include "evaluation_arena.h"
+
+TEST(EvaluationArenaTest, Capacity) {
+  EXPECT_EQ(EvaluationArena::Capacity(1), 4);
+  EXPECT_EQ(EvaluationArena::Capacity(4), 4);
+  EXPECT_EQ(EvaluationArena::Capacity(5), 8);
+  EXPECT_EQ(EvaluationArena::Capacity(33), 64);
+  EXPECT_EQ(EvaluationArena::Capacity(64), 64);
+}
+
+TEST(EvaluationArenaTest, NoOverlap) {
+  EvaluationArena arena(1 << 22);
+  std::vector<std::future<std::vector<Evaluation*>>> futures;
+  for (int i = 0; i < 4; ++i) {
+    futures.push_back(std::async(std::launch::async, [&arena]() {
+      std::vector<Evaluation*> result;
+      for (int j = 0; j < 10000; ++j) {
+        result.push_back(arena.Allocate(64));
+      }
+      return result;
+    }));
+  }
+  std::set<Evaluation*> all;
+  for (auto& future : futures) {
+    for (Evaluation* evaluations : future.get()) {
+      ASSERT_NE(evaluations, nullptr);
+      all.insert(evaluations);
+    }
+  }
+  ASSERT_EQ(all.size(), 40000);
+  for (auto it = all.begin(); std::next(it) != all.end(); ++it) {
+    EXPECT_GE(*std::next(it) - *it, 64);
+  }
+}
+
+TEST(EvaluationArenaTest, ResetReusesMemory) {
+  EvaluationArena arena(1 << 20);
+  Evaluation* first = arena.Allocate(8);
+  arena.Allocate(16);
+  uint64_t allocated = arena.AllocatedBytes();
+  arena.Reset();
+  EXPECT_EQ(arena.UsedBytes(), 0);
+  EXPECT_EQ(arena.Allocate(8), first);
+  EXPECT_EQ(arena.AllocatedBytes(), allocated);
+}
+
+TEST(EvaluationArenaTest, Full) {
+  EvaluationArena arena(EvaluationArena::kChunkSize);
+  for (uint64_t i = 0; i < EvaluationArena::kChunkSize / 64; ++i) {
+    ASSERT_NE(arena.Allocate(64), nullptr);
+  }
+  EXPECT_EQ(arena.Allocate(64), nullptr);
+}
+
+TEST(EvaluationArenaTest, InterleavedArenas) {
+  EvaluationArena arena1(1 << 20);
+  EvaluationArena arena2(1 << 20);
+  for (int i = 0; i < EvaluationArena::kBlockSize / 8; ++i) {
+    ASSERT_NE(arena1.Allocate(8), nullptr);
+    ASSERT_NE(arena2.Allocate(8), nullptr);
+  }
+  EXPECT_EQ(arena1.UsedBytes(), EvaluationArena::kBlockSize * sizeof(Evaluation));
+  EXPECT_EQ(arena2.UsedBytes(), EvaluationArena::kBlockSize * sizeof(Evaluation));
+}
@@ -13,6 +13,12 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <tuple>
 #include <vector>
 
 #include "evaluator_derivative.h"
@@ -35,33 +41,276 @@ std::pair<TreeNode*, bool> TreeNodeSupplier::AddTreeNode(
   return std::make_pair(&node, true);
 }
 
+namespace {
+
+constexpr uint32_t kSnapshotMagic = 0x534e5354;  // "SNST"
+constexpr uint32_t kSnapshotVersion = 2;
+
+template<typename T>
+void AppendValue(std::vector<char>* result, T value) {
+  result->insert(result->end(), (const char*) &value, (const char*) &value + sizeof(T));
+}
+
+template<typename T>
+const char* ReadValue(const char* data, const char* end, T* value) {
+  if (data == nullptr || end - data < (std::ptrdiff_t) sizeof(T)) {
+    return nullptr;
+  }
+  memcpy(value, data, sizeof(T));
+  return data + sizeof(T);
+}
+
+// A node read by LoadSnapshot, before it is added to the TreeNodeSupplier.
+struct SnapshotNode {
+  Board board;
+  Square depth;
+  std::vector<uint32_t> children;
+  // The fields written by TreeNode::AppendSnapshot.
+  const char* fields;
+};
+
+}  // namespace
+
+void EvaluatorDerivative::SaveSnapshot(const std::string& filepath) const {
+  assert(first_position_ != nullptr);
+  std::vector<TreeNode*> nodes = {first_position_};
+  std::unordered_map<TreeNode*, uint32_t> ids = {{first_position_, 0}};
+  for (int i = 0; i < nodes.size(); ++i) {
+    TreeNode* node = nodes[i];
+    for (auto child = node->ChildrenStart(); child != node->ChildrenEnd(); ++child) {
+      if (ids.emplace(*child, (uint32_t) nodes.size()).second) {
+        nodes.push_back(*child);
+      }
+    }
+  }
+  std::vector<char> result;
+  AppendValue(&result, kSnapshotMagic);
+  AppendValue(&result, kSnapshotVersion);
+  AppendValue(&result, lower_);
+  AppendValue(&result, upper_);
+  AppendValue(&result, weak_lower_.load());
+  AppendValue(&result, weak_upper_.load());
+  AppendValue(&result, approx_);
+  AppendValue(&result, n_thread_multiplier_.load());
+  AppendValue(&result, previous_elapsed_time);
+  AppendValue(&result, (uint32_t) nodes.size());
+  for (TreeNode* node : nodes) {
+    SerializedBoard board = node->ToBoard().Serialize();
+    result.insert(result.end(), board.begin(), board.end());
+    AppendValue(&result, node->Depth());
+    AppendValue(&result, (Square) (node->ChildrenEnd() - node->ChildrenStart()));
+    for (auto child = node->ChildrenStart(); child != node->ChildrenEnd(); ++child) {
+      AppendValue(&result, ids[*child]);
+    }
+    node->AppendSnapshot(&result);
+  }
+  hash_map_->AppendSnapshot(&result);
+
+  // Write a new file and rename it, so that a crash never leaves a partial
+  // snapshot in filepath.
+  std::string tmp_filepath = filepath + ".tmp";
+  {
+    std::ofstream file(tmp_filepath, std::ios::binary | std::ios::trunc);
+    file.write(result.data(), (std::streamsize) result.size());
+  }
+  std::filesystem::rename(tmp_filepath, filepath);
+}
+
+bool EvaluatorDerivative::LoadSnapshot(const std::string& filepath) {
+  std::ifstream file(filepath, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::vector<char> snapshot((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  const char* data = snapshot.data();
+  const char* end = data + snapshot.size();
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  Eval lower;
+  Eval upper;
+  Eval weak_lower;
+  Eval weak_upper;
+  uint8_t approx;
+  uint64_t n_thread_multiplier;
+  double elapsed_time;
+  uint32_t n_nodes = 0;
+  data = ReadValue(data, end, &magic);
+  data = ReadValue(data, end, &version);
+  data = ReadValue(data, end, &lower);
+  data = ReadValue(data, end, &upper);
+  data = ReadValue(data, end, &weak_lower);
+  data = ReadValue(data, end, &weak_upper);
+  data = ReadValue(data, end, &approx);
+  data = ReadValue(data, end, &n_thread_multiplier);
+  data = ReadValue(data, end, &elapsed_time);
+  data = ReadValue(data, end, &n_nodes);
+  if (data == nullptr || magic != kSnapshotMagic || version != kSnapshotVersion
+      || lower < kMinEval || lower > upper || upper > kMaxEval
+      || weak_lower > weak_upper || approx > 1 || n_nodes == 0
+      || (int64_t) n_nodes > (int64_t) kDerivativeEvaluatorSize - tree_node_supplier_->NumTreeNodes()) {
+    return false;
+  }
+
+  // Validates the whole file before changing anything.
+  std::vector<SnapshotNode> nodes;
+  std::set<std::tuple<BitPattern, BitPattern, Square>> boards;
+  for (uint32_t i = 0; i < n_nodes; ++i) {
+    if (end - data < kSerializedBoardSize) {
+      return false;
+    }
+    SnapshotNode node;
+    node.board = Board::Deserialize(snapshot.begin() + (data - snapshot.data()));
+    data += kSerializedBoardSize;
+    Square n_children = 0;
+    data = ReadValue(data, end, &node.depth);
+    data = ReadValue(data, end, &n_children);
+    if (data == nullptr || n_children > kMaxChildren) {
+      return false;
+    }
+    node.children.resize(n_children);
+    for (uint32_t& child : node.children) {
+      data = ReadValue(data, end, &child);
+    }
+    node.fields = data;
+    data = TreeNode::CheckSnapshot(data, end);
+    BitPattern player = node.board.Player();
+    BitPattern opponent = node.board.Opponent();
+    if (data == nullptr || (i == 0) != (node.depth == 0)
+        || !boards.emplace(player, opponent, node.depth).second
+        || tree_node_supplier_->Mutable(player, opponent, node.depth, TreeNodeEvaluatorIndex(node.depth))) {
+      return false;
+    }
+    nodes.push_back(std::move(node));
+  }
+  for (const SnapshotNode& node : nodes) {
+    std::vector<uint32_t> children = node.children;
+    std::sort(children.begin(), children.end());
+    if (std::adjacent_find(children.begin(), children.end()) != children.end()) {
+      return false;
+    }
+    for (uint32_t id : children) {
+      // The children are one move deeper, so the tree has no cycles.
+      if (id >= n_nodes || nodes[id].depth != node.depth + 1) {
+        return false;
+      }
+    }
+  }
+  uint64_t n_entries;
+  if (ReadValue(data, end, &n_entries) == nullptr) {
+    return false;
+  }
+  uint64_t entries_size = (uint64_t) (end - data) - sizeof(n_entries);
+  if (entries_size % HashMap<kBitHashMap>::kSnapshotEntrySize != 0
+      || entries_size / HashMap<kBitHashMap>::kSnapshotEntrySize != n_entries) {
+    return false;
+  }
+
+  lower_ = lower;
+  upper_ = upper;
+  weak_lower_ = weak_lower;
+  weak_upper_ = weak_upper;
+  approx_ = approx != 0;
+  n_thread_multiplier_ = n_thread_multiplier;
+  previous_elapsed_time = elapsed_time;
+  num_tree_nodes_ = 0;
+  std::vector<TreeNode*> tree_nodes;
+  for (const SnapshotNode& node : nodes) {
+    auto [tree_node, just_added] = AddTreeNode(node.board.Player(), node.board.Opponent(), node.depth);
+    assert(just_added);
+    const char* fields_end = tree_node->RestoreSnapshot(node.fields, end);
+    assert(fields_end);
+    tree_nodes.push_back(tree_node);
+  }
+  for (uint32_t i = 0; i < n_nodes; ++i) {
+    if (nodes[i].children.empty()) {
+      continue;
+    }
+    std::vector<TreeNode*> children;
+    for (uint32_t id : nodes[i].children) {
+      children.push_back(tree_nodes[id]);
+    }
+    tree_nodes[i]->SetChildrenNoUpdate(children);
+  }
+  hash_map_->RestoreSnapshot(data, end);
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->ResetStats();
+  }
+  first_position_ = tree_nodes[0];
+  best_advancement_ = 0;
+  is_updating_weak_lower_upper_.clear();
+  status_ = NONE;
+  return true;
+}
+
 void EvaluatorThread::Run() {
-  NVisited n_visited;
   TreeNode* first_position = evaluator_->first_position_;
   int last_eval_goal = kLessThenMinEval;
+  std::vector<TreeNodeLeafToUpdate> leaves;
+  std::vector<NVisited> n_visited;
   while (!evaluator_->CheckFinished()) {
-    evaluator_->UpdateWeakLowerUpper();
-    auto leaf_opt = TreeNodeLeafToUpdate::BestDescendant(
-        first_position, evaluator_->NThreadMultiplier(), last_eval_goal);
-    if (!leaf_opt) {
-      stats_.Add(1, NEXT_POSITION_FAIL);
-      evaluator_->UpdateNThreadMultiplierFail();
-      continue;
+    ElapsedTime time_next_position;
+    {
+      TraceScope trace(&trace_, TRACE_SELECT);
+      evaluator_->UpdateWeakLowerUpper();
+      auto leaf_opt = TreeNodeLeafToUpdate::BestDescendant(
+          first_position, evaluator_->NThreadMultiplier(), last_eval_goal);
+      if (!leaf_opt) {
+        trace.SetType(TRACE_SELECT_FAIL);
+        stats_.Add(1, NEXT_POSITION_FAIL);
+        evaluator_->UpdateNThreadMultiplierFail();
+        continue;
+      }
+      stats_.Add(1, NEXT_POSITION_SUCCESS);
+      evaluator_->UpdateNThreadMultiplierSuccess();
+      TreeNode* node = (TreeNode*) leaf_opt->Leaf();
+      last_eval_goal = leaf_opt->EvalGoal() * (node->Depth() % 2 == 0 ? 1 : -1);
+      leaves = {*leaf_opt};
+      for (TreeNodeLeafToUpdate& sibling : leaf_opt->SiblingLeaves(leaves_per_descent_ - 1, evaluator_->NThreadMultiplier())) {
+        leaves.push_back(std::move(sibling));
+      }
+    }
+    double time_select = time_next_position.Get();
+
+    ElapsedTime time_deepen;
+    n_visited.clear();
+    for (const TreeNodeLeafToUpdate& leaf : leaves) {
+      n_visited.push_back(Deepen(leaf));
+    }
+    double time_expand = time_deepen.Get();
+
+    ElapsedTime time_backup;
+    {
+      TraceScope trace(&trace_, TRACE_BACKUP);
+      stats_.Add(TreeNodeLeafToUpdate::Finalize(leaves, n_visited), UPDATE_FATHER);
     }
-    stats_.Add(1, NEXT_POSITION_SUCCESS);
-    evaluator_->UpdateNThreadMultiplierSuccess();
-    auto leaf = *leaf_opt;
-    TreeNode* node = (TreeNode*) leaf.Leaf();
-    last_eval_goal = leaf.EvalGoal() * (node->Depth() % 2 == 0 ? 1 : -1);
-    assert(leaf.Alpha() <= leaf.EvalGoal() && leaf.EvalGoal() <= leaf.Beta());
-    assert(node->IsLeaf());
-    if (node->TreeNode::ToBeSolved(leaf.Alpha(), leaf.Beta(), evaluator_->num_tree_nodes_, first_position->GetNVisited())) {
-      n_visited = SolvePosition(leaf, (int) std::max(50000.0, node->TreeNode::RemainingWork(leaf.Alpha(), leaf.Beta())));
-    } else {
-      n_visited = AddChildren(leaf);
-    }
-    leaf.Finalize(n_visited);
     evaluator_->just_started_ = false;
+    UpdateLeavesPerDescent(time_select + time_backup.Get(), time_expand / leaves.size());
+    stats_.AddTimeNextPosition(time_select + time_backup.Get());
+    stats_.AddTimeDeepen(time_expand);
+  }
+}
+
+NVisited EvaluatorThread::Deepen(const TreeNodeLeafToUpdate& leaf) {
+  TreeNode* node = (TreeNode*) leaf.Leaf();
+  TreeNode* first_position = evaluator_->first_position_;
+  assert(leaf.Alpha() <= leaf.EvalGoal() && leaf.EvalGoal() <= leaf.Beta());
+  assert(node->IsLeaf());
+  if (node->TreeNode::ToBeSolved(leaf.Alpha(), leaf.Beta(), evaluator_->num_tree_nodes_, first_position->GetNVisited())) {
+    TraceScope trace(&trace_, TRACE_SOLVE);
+    return SolvePosition(leaf, (int) std::max(50000.0, node->TreeNode::RemainingWork(leaf.Alpha(), leaf.Beta())));
+  } else {
+    TraceScope trace(&trace_, TRACE_EXPAND);
+    return AddChildren(leaf);
+  }
+}
+
+void EvaluatorThread::UpdateLeavesPerDescent(double time_next_position, double time_deepen_per_leaf) {
+  // Expanding more leaves per descent only pays off when descending and
+  // backing up costs more than expanding a leaf.
+  if (time_next_position > time_deepen_per_leaf) {
+    leaves_per_descent_ = std::min(leaves_per_descent_ + 1, evaluator_->max_leaves_per_descent_);
+  } else if (time_next_position < time_deepen_per_leaf / 4) {
+    leaves_per_descent_ = std::max(leaves_per_descent_ - 1, 1);
   }
 }
 
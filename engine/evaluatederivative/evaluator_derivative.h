@@ -30,6 +30,7 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "trace.h"
 #include "tree_node.h"
 #include "../utils/constants.h"
 #include "../evaluatealphabeta/evaluator_alpha_beta.h"
@@ -77,8 +78,13 @@ class TreeNodeSupplier {
   TreeNodeSupplier() :
       tree_node_index_(kHashMapSize),
       num_nodes_(0),
-      first_valid_index_(1) {
+      first_valid_index_(1),
+      // Each node wastes at most as much as its final array.
+      evaluation_arena_((uint64_t) kDerivativeEvaluatorSize * 2 * EvaluationArena::kMaxArraySize) {
     tree_nodes_ = new TreeNode[kDerivativeEvaluatorSize];
+    for (int i = 0; i < kDerivativeEvaluatorSize; ++i) {
+      tree_nodes_[i].SetEvaluationArena(&evaluation_arena_);
+    }
     FullResetHashMap();
   }
   ~TreeNodeSupplier() {
@@ -108,12 +114,17 @@ class TreeNodeSupplier {
       FullResetHashMap();
     }
     num_nodes_ = 0;
+    evaluation_arena_.Reset();
   }
 
   int NumTreeNodes() {
     return num_nodes_;
   }
 
+  const EvaluationArena& GetEvaluationArena() const {
+    return evaluation_arena_;
+  }
+
   std::pair<TreeNode*, bool> AddTreeNode(
       BitPattern player, BitPattern opponent, Square depth, uint8_t evaluator_index);
 
@@ -122,6 +133,7 @@ class TreeNodeSupplier {
   std::vector<std::atomic_uint32_t> tree_node_index_;
   std::atomic_uint32_t num_nodes_;
   uint32_t first_valid_index_;
+  EvaluationArena evaluation_arena_;
   Random random_;
 
   TreeNode* MutableInternal(BitPattern player, BitPattern opponent, Square depth, uint8_t evaluator_index) const {
@@ -185,16 +197,25 @@ class EvaluatorThread {
 
   const Stats& GetStats() const { return stats_; }
 
+  TraceBuffer* GetTrace() { return &trace_; }
+
   NVisited AddChildren(const TreeNodeLeafToUpdate& leaf);
 
  private:
   EvaluatorAlphaBeta evaluator_alpha_beta_;
   std::unique_ptr<EvaluatorDepthOneBase> evaluator_depth_one_;
   Stats stats_;
+  TraceBuffer trace_;
   EvaluatorDerivative* evaluator_;
   ElapsedTime t;
 
+  // Number of leaves expanded after each descent (see
+  // EvaluatorDerivative::SetMaxLeavesPerDescent).
+  int leaves_per_descent_ = 1;
+
   NVisited SolvePosition(const TreeNodeLeafToUpdate& leaf, int max_proof);
+  NVisited Deepen(const TreeNodeLeafToUpdate& leaf);
+  void UpdateLeavesPerDescent(double time_next_position, double time_deepen_per_leaf);
 };
 
 class EvaluatorDerivative {
@@ -206,6 +227,7 @@ class EvaluatorDerivative {
       index_(index),
       evaluator_depth_one_(evaluator_depth_one),
       hash_map_(hash_map) {
+    assert(index_ < kSharedEvaluator);
     threads_.push_back(std::make_unique<EvaluatorThread>(hash_map, evaluator_depth_one, this));
   }
 
@@ -264,6 +286,34 @@ class EvaluatorDerivative {
     ContinueEvaluate(max_n_visited, max_time, n_threads);
   }
 
+  // Saves the tree below the first position and the HashMap to `filepath`, so
+  // that LoadSnapshot can resume the evaluation in another process. Must not
+  // run during an evaluation.
+  void SaveSnapshot(const std::string& filepath) const;
+
+  // Rebuilds the tree saved by SaveSnapshot in the TreeNodeSupplier (that
+  // must not contain any of its positions, e.g. after TreeNodeSupplier::Reset)
+  // and restores the HashMap. Then, the evaluation continues with
+  // ContinueEvaluate. Returns false (without changing the evaluator, the
+  // TreeNodeSupplier or the HashMap) if the file is missing or invalid.
+  bool LoadSnapshot(const std::string& filepath);
+
+  // After each descent, also expands up to max_leaves_per_descent - 1 sibling
+  // leaves of the best leaf, adapting the number to the time spent descending
+  // and backing up versus expanding. 1 disables it.
+  void SetMaxLeavesPerDescent(int max_leaves_per_descent) {
+    max_leaves_per_descent_ = std::max(1, max_leaves_per_descent);
+  }
+
+  // Shares the positions below the first one with all the other evaluators
+  // sharing the TreeNodeSupplier, as long as they also call this. Useful when
+  // they analyze positions that transpose into each other (e.g., the children
+  // of the same position). Shared nodes keep the union of the windows of the
+  // evaluators that reach them.
+  void SetShareTranspositions(bool share_transpositions) {
+    share_transpositions_ = share_transpositions;
+  }
+
   void Stop() {
     if (status_ == RUNNING || status_ == STOPPED_TIME) {
       status_ = KILLING;
@@ -286,6 +336,24 @@ class EvaluatorDerivative {
 
   uint8_t Index() const { return index_; }
 
+  // Records the last events_per_thread selections, expansions, solves and
+  // backups of each thread (0 disables it), for WriteTrace.
+  void SetTraceCapacity(int events_per_thread) {
+    trace_capacity_ = events_per_thread;
+    for (auto& thread : threads_) {
+      thread->GetTrace()->SetCapacity(trace_capacity_);
+    }
+  }
+
+  // Writes the events recorded so far in the Chrome trace format.
+  void WriteTrace(std::ostream& stream) const {
+    std::vector<std::vector<TraceEvent>> events;
+    for (const auto& thread : threads_) {
+      events.push_back(thread->GetTrace()->Events());
+    }
+    WriteChromeTrace(events, stream);
+  }
+
   std::pair<Eval, Eval> GetWeakLowerUpper(Square depth) const {
     if (depth & 1) {
       return std::make_pair(-weak_upper_, -weak_lower_);
@@ -322,11 +390,15 @@ class EvaluatorDerivative {
   EvaluatorFactory evaluator_depth_one_;
   HashMap<kBitHashMap>* hash_map_;
   double previous_elapsed_time;
+  int max_leaves_per_descent_ = 1;
+  bool share_transpositions_ = false;
+  int trace_capacity_ = 0;
 
   void Run(int n_threads) {
     std::vector<std::future<void>> futures;
     while (threads_.size() <= n_threads) {
       threads_.push_back(std::make_unique<EvaluatorThread>(hash_map_, evaluator_depth_one_, this));
+      threads_.back()->GetTrace()->SetCapacity(trace_capacity_);
     }
     futures.push_back(std::async(std::launch::deferred, &EvaluatorThread::Run, threads_[0].get()));
     for (int i = 1; i < n_threads; ++i) {
@@ -422,9 +494,14 @@ class EvaluatorDerivative {
         && weak_upper_ <= first_position_->WeakUpper();
   }
 
+  // The evaluator index of the nodes at this depth in the TreeNodeSupplier.
+  uint8_t TreeNodeEvaluatorIndex(Square depth) const {
+    return share_transpositions_ && depth > 0 ? kSharedEvaluator : Index();
+  }
+
   std::pair<TreeNode*, bool> AddTreeNode(
       BitPattern player, BitPattern opponent, Square depth) {
-    auto pair = tree_node_supplier_->AddTreeNode(player, opponent, depth, Index());
+    auto pair = tree_node_supplier_->AddTreeNode(player, opponent, depth, TreeNodeEvaluatorIndex(depth));
     // Add 1 if it's a new node, 0 otherwise.
     num_tree_nodes_ += pair.second;
     return pair;
@@ -18,6 +18,9 @@
 #include "../hashmap/hash_map.h"
 #include "../evaluatealphabeta/evaluator_alpha_beta.h"
 #include "../evaluatedepthone/pattern_evaluator.h"
+#include "../utils/files.h"
+
+const std::string kSnapshotFile = "app/testdata/tmp/evaluator_derivative_test/snapshot.bin";
 
 TEST(EvaluatorDerivativeTest, Base) {
   EvalType evals = LoadEvals();
@@ -41,4 +44,122 @@ TEST(EvaluatorDerivativeTest, Endgame) {
   std::cout << supplier.Get(initial_board, 0, 0)->GetEval() << "\n";
 
 //  std::cout << evaluator_derivative.Get(initial_board)->GetEvaluation(1).ProbGreaterEqual() << "\n";
-}
\ No newline at end of file
+}
+
+TEST(EvaluatorDerivativeTest, ShareTranspositions) {
+  EvalType evals = LoadEvals();
+  HashMap<kBitHashMap> hash_map;
+  TreeNodeSupplier supplier;
+  EvaluatorAlphaBeta evaluator_alpha_beta(&hash_map, PatternEvaluator::Factory(evals.data()));
+  Board initial_board("e6f4c3c4d3d6e3c2b3c5b4f3d2c1d7c6f5c7f6e8b5e7b6g6g5h6g4h5g3h2h4h3f7f8g7f2e1d1g8");
+  std::vector<Board> children = GetNextBoardsWithPass(initial_board);
+  ASSERT_GT(children.size(), 1);
+  std::vector<std::unique_ptr<EvaluatorDerivative>> evaluators;
+  for (int i = 0; i < children.size(); ++i) {
+    evaluators.push_back(std::make_unique<EvaluatorDerivative>(
+        &supplier, &hash_map, PatternEvaluator::Factory(evals.data()), (uint8_t) i));
+    evaluators[i]->SetShareTranspositions(true);
+    evaluators[i]->Evaluate(children[i].Player(), children[i].Opponent(), kMinEval + 1, kMaxEval - 1, 20000, 100, 1, false);
+  }
+  // Each evaluator now also updates nodes created by the others.
+  for (auto& evaluator : evaluators) {
+    evaluator->ContinueEvaluate(20000, 100, 1);
+  }
+  for (auto& evaluator : evaluators) {
+    auto first_position = evaluator->GetFirstPosition();
+    Eval eval = EvalLargeToEvalRound(evaluator_alpha_beta.Evaluate(
+        first_position->Player(), first_position->Opponent(), 64));
+    EXPECT_LE(first_position->Lower(), eval);
+    EXPECT_GE(first_position->Upper(), eval);
+  }
+}
+
+TEST(EvaluatorDerivativeTest, Snapshot) {
+  EvalType evals = LoadEvals();
+  Board b("e6f4c3c4d3d6e3c2b3c5b4f3d2c1d7c6f5c7f6e8b5e7b6g6g5h6g4h5g3h2");
+  CreateEmptyFileWithDirectories(kSnapshotFile);
+
+  HashMap<kBitHashMap> hash_map;
+  TreeNodeSupplier supplier;
+  EvaluatorDerivative evaluator(&supplier, &hash_map, PatternEvaluator::Factory(evals.data()));
+  evaluator.Evaluate(b.Player(), b.Opponent(), kMinEval + 1, kMaxEval - 1, 50000, 100, 1, false);
+  evaluator.SaveSnapshot(kSnapshotFile);
+
+  HashMap<kBitHashMap> loaded_hash_map;
+  TreeNodeSupplier loaded_supplier;
+  EvaluatorDerivative loaded_evaluator(&loaded_supplier, &loaded_hash_map, PatternEvaluator::Factory(evals.data()));
+  ASSERT_TRUE(loaded_evaluator.LoadSnapshot(kSnapshotFile));
+  EXPECT_EQ(loaded_supplier.NumTreeNodes(), supplier.NumTreeNodes());
+  auto first_position = evaluator.GetFirstPosition();
+  auto loaded_first_position = loaded_evaluator.GetFirstPosition();
+  EXPECT_TRUE(loaded_first_position->Equals(*first_position, false));
+  EXPECT_EQ(loaded_first_position->GetNVisited(), first_position->GetNVisited());
+
+  loaded_evaluator.ContinueEvaluate(50000, 100, 1);
+  EXPECT_GT(loaded_evaluator.GetFirstPosition()->GetNVisited(), first_position->GetNVisited());
+  fs::remove(kSnapshotFile);
+}
+
+TEST(EvaluatorDerivativeTest, SnapshotCorrupted) {
+  // The header has magic, version, 4 Eval, approx, n_thread_multiplier, the
+  // elapsed time and the number of nodes. Then, each node starts with board,
+  // depth, number of children and children ids.
+  constexpr int kElapsedTimeOffset = 2 * sizeof(uint32_t) + 4 * sizeof(Eval) + sizeof(bool) + sizeof(uint64_t);
+  constexpr int kFirstChildOffset =
+      kElapsedTimeOffset + sizeof(double) + sizeof(uint32_t) + kSerializedBoardSize + 2 * sizeof(Square);
+  EvalType evals = LoadEvals();
+  Board b("e6f4c3c4d3d6e3c2b3c5b4f3d2c1d7c6f5c7f6e8b5e7b6g6g5h6g4h5g3h2");
+  CreateEmptyFileWithDirectories(kSnapshotFile);
+  HashMap<kBitHashMap> hash_map;
+  TreeNodeSupplier supplier;
+  EvaluatorDerivative evaluator(&supplier, &hash_map, PatternEvaluator::Factory(evals.data()));
+  evaluator.Evaluate(b.Player(), b.Opponent(), kMinEval + 1, kMaxEval - 1, 5000, 100, 1, false);
+  evaluator.SaveSnapshot(kSnapshotFile);
+  std::string snapshot = LoadTextFile(kSnapshotFile);
+  ASSERT_GE((Square) snapshot[kFirstChildOffset - sizeof(Square)], 2);
+
+  std::vector<std::string> corrupted;
+  for (int size : {4, 20, 100, (int) snapshot.size() / 2, (int) snapshot.size() - 1}) {
+    corrupted.push_back(snapshot.substr(0, size));
+  }
+  // A child that is the first position (a cycle), and a duplicate child.
+  for (uint32_t child : {0U, *(uint32_t*) &snapshot[kFirstChildOffset]}) {
+    corrupted.push_back(snapshot);
+    corrupted.back().replace(kFirstChildOffset + sizeof(uint32_t), sizeof(uint32_t), (const char*) &child, sizeof(uint32_t));
+  }
+  // A failed load leaves the evaluator and the TreeNodeSupplier untouched, so
+  // the next load works without resetting them.
+  HashMap<kBitHashMap> loaded_hash_map;
+  TreeNodeSupplier loaded_supplier;
+  EvaluatorDerivative loaded_evaluator(&loaded_supplier, &loaded_hash_map, PatternEvaluator::Factory(evals.data()));
+  for (const std::string& content : corrupted) {
+    std::ofstream(kSnapshotFile, std::ios::binary | std::ios::trunc) << content;
+    EXPECT_FALSE(loaded_evaluator.LoadSnapshot(kSnapshotFile));
+    EXPECT_EQ(loaded_supplier.NumTreeNodes(), 0);
+  }
+  // A wrong magic number leaves the evaluator untouched.
+  std::string wrong_magic = snapshot;
+  wrong_magic[0] ^= 1;
+  double elapsed_time = evaluator.GetElapsedTime();
+  double wrong_elapsed_time = elapsed_time + 1000;
+  wrong_magic.replace(kElapsedTimeOffset, sizeof(double), (const char*) &wrong_elapsed_time, sizeof(double));
+  std::ofstream(kSnapshotFile, std::ios::binary | std::ios::trunc) << wrong_magic;
+  EXPECT_FALSE(evaluator.LoadSnapshot(kSnapshotFile));
+  EXPECT_EQ(evaluator.GetElapsedTime(), elapsed_time);
+
+  std::ofstream(kSnapshotFile, std::ios::binary | std::ios::trunc) << snapshot;
+  EXPECT_TRUE(loaded_evaluator.LoadSnapshot(kSnapshotFile));
+  EXPECT_EQ(loaded_evaluator.GetElapsedTime(), evaluator.GetElapsedTime());
+  EXPECT_TRUE(loaded_evaluator.GetFirstPosition()->Equals(*evaluator.GetFirstPosition(), false));
+  // The positions are already in the TreeNodeSupplier.
+  EXPECT_FALSE(loaded_evaluator.LoadSnapshot(kSnapshotFile));
+  fs::remove(kSnapshotFile);
+}
+
+TEST(EvaluatorDerivativeTest, SnapshotMissing) {
+  EvalType evals = LoadEvals();
+  HashMap<kBitHashMap> hash_map;
+  TreeNodeSupplier supplier;
+  EvaluatorDerivative evaluator(&supplier, &hash_map, PatternEvaluator::Factory(evals.data()));
+  EXPECT_FALSE(evaluator.LoadSnapshot(kSnapshotFile + ".missing"));
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+enum TraceEventType : uint8_t {
+  TRACE_SELECT = 0,
+  TRACE_SELECT_FAIL = 1,
+  TRACE_EXPAND = 2,
+  TRACE_SOLVE = 3,
+  TRACE_BACKUP = 4,
+};
+
+struct TraceEvent {
+  // Nanoseconds since the start of the process.
+  uint64_t start;
+  uint64_t duration;
+  TraceEventType type;
+};
+
+// Ring buffer with the last events of one thread. It is not thread safe: each
+// thread writes its own buffer, and the buffers are read after the threads
+// finish. With capacity 0 (the default), it records nothing and TraceScope
+// does not even read the clock.
+class TraceBuffer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void SetCapacity(int capacity) {
+    events_.clear();
+    events_.reserve(capacity);
+    capacity_ = capacity;
+    next_ = 0;
+  }
+
+  bool Enabled() const { return capacity_ > 0; }
+
+  void Add(TraceEventType type, Clock::time_point start) {
+    Clock::time_point end = Clock::now();
+    TraceEvent event {
+        (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch_).count(),
+        (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+        type};
+    if (events_.size() < (size_t) capacity_) {
+      events_.push_back(event);
+    } else {
+      events_[next_] = event;
+    }
+    next_ = (next_ + 1) % capacity_;
+  }
+
+  // The events, oldest first.
+  std::vector<TraceEvent> Events() const {
+    if (events_.size() < (size_t) capacity_) {
+      return events_;
+    }
+    std::vector<TraceEvent> result(events_.begin() + next_, events_.end());
+    result.insert(result.end(), events_.begin(), events_.begin() + next_);
+    return result;
+  }
+
+ private:
+  std::vector<TraceEvent> events_;
+  int capacity_ = 0;
+  int next_ = 0;
+
+  static inline const Clock::time_point epoch_ = Clock::now();
+};
+
+// Adds an event with the lifetime of this object to the buffer.
+class TraceScope {
+ public:
+  TraceScope(TraceBuffer* buffer, TraceEventType type) :
+      buffer_(buffer->Enabled() ? buffer : nullptr),
+      type_(type),
+      start_(buffer_ ? TraceBuffer::Clock::now() : TraceBuffer::Clock::time_point()) {}
+
+  ~TraceScope() {
+    if (buffer_) {
+      buffer_->Add(type_, start_);
+    }
+  }
+
+  void SetType(TraceEventType type) { type_ = type; }
+
+ private:
+  TraceBuffer* buffer_;
+  TraceEventType type_;
+  TraceBuffer::Clock::time_point start_;
+};
+
+// Writes the events in the Chrome trace format (open with chrome://tracing or
+// https://ui.perfetto.dev), one track per thread.
+inline void WriteChromeTrace(const std::vector<std::vector<TraceEvent>>& threads, std::ostream& stream) {
+  constexpr const char* kNames[] = {"select", "select_fail", "expand", "solve", "backup"};
+  stream << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+  bool first = true;
+  for (int tid = 0; tid < threads.size(); ++tid) {
+    for (const TraceEvent& event : threads[tid]) {
+      stream << (first ? "\n" : ",\n")
+             << "{\"name\":\"" << kNames[event.type] << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+             << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+      first = false;
+    }
+  }
+  stream << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+#endif  // TRACE_H
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <sstream>
+#include "trace.h"
+
+TEST(TraceTest, Disabled) {
+  TraceBuffer buffer;
+  { TraceScope scope(&buffer, TRACE_SELECT); }
+  EXPECT_TRUE(buffer.Events().empty());
+}
+
+TEST(TraceTest, KeepsLastEvents) {
+  TraceBuffer buffer;
+  buffer.SetCapacity(3);
+  for (TraceEventType type : {TRACE_SELECT, TRACE_EXPAND, TRACE_SOLVE, TRACE_BACKUP}) {
+    TraceScope scope(&buffer, type);
+  }
+  std::vector<TraceEvent> events = buffer.Events();
+  ASSERT_EQ(events.size(), 3);
+  EXPECT_EQ(events[0].type, TRACE_EXPAND);
+  EXPECT_EQ(events[1].type, TRACE_SOLVE);
+  EXPECT_EQ(events[2].type, TRACE_BACKUP);
+  EXPECT_LE(events[0].start, events[1].start);
+  EXPECT_LE(events[1].start, events[2].start);
+}
+
+TEST(TraceTest, LongEvent) {
+  TraceBuffer buffer;
+  buffer.SetCapacity(1);
+  // Longer than 2^32 nanoseconds.
+  buffer.Add(TRACE_SOLVE, TraceBuffer::Clock::now() - std::chrono::seconds(10));
+  std::vector<TraceEvent> events = buffer.Events();
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_GE(events[0].duration, 10000000000ULL);
+}
+
+TEST(TraceTest, ChromeTrace) {
+  std::stringstream stream;
+  WriteChromeTrace({{{1000, 2000, TRACE_SELECT}}, {{3000, 500, TRACE_BACKUP}}}, stream);
+  EXPECT_EQ(
+      stream.str(),
+      "{\"traceEvents\":[\n"
+      "{\"name\":\"select\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":1.000,\"dur\":2.000},\n"
+      "{\"name\":\"backup\",\"ph\":\"X\",\"pid\":0,\"tid\":1,\"ts\":3.000,\"dur\":0.500}\n"
+      "],\"displayTimeUnit\":\"ns\"}\n");
+}
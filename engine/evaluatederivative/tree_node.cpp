@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <cstring>
 #include <limits>
 #include "evaluator_derivative.h"
 #include "tree_node.h"
@@ -23,19 +24,8 @@
 constexpr int kMutexAtDepthBits = 10;
 constexpr int kMutexAtDepthSize = 1 << kMutexAtDepthBits;
 
-namespace {
-
-std::vector<std::vector<std::mutex>> BuildMutexAtDepth() {
-  std::vector<std::vector<std::mutex>> mutex_at_depth(120);
-  for (int i = 0; i < 120; ++i) {
-    mutex_at_depth[i] = std::vector<std::mutex>(kMutexAtDepthSize);
-  }
-  return mutex_at_depth;
-}
-}  // namespace
-
 std::atomic_bool TreeNode::extend_eval_failed_(false);
-std::vector<std::vector<std::mutex>> TreeNode::mutex_at_depth_(BuildMutexAtDepth());
+std::vector<std::mutex> TreeNode::mutex_at_depth_(120 * kMutexAtDepthSize);
 
 std::ostream& operator<<(std::ostream& stream, const Node& b) {
   stream << b.Player() << " " << b.Opponent() << ": " << b.LeafEval()
@@ -90,19 +80,121 @@ void TreeNode::SetSolved(EvalLarge lower, EvalLarge upper, const EvaluatorDeriva
   UpdateLeafWeakLowerUpper(weak_lower_upper.first, weak_lower_upper.second);
 }
 
+namespace {
+
+template<typename T>
+void AppendValue(std::vector<char>* result, T value) {
+  result->insert(result->end(), (const char*) &value, (const char*) &value + sizeof(T));
+}
+
+template<typename T>
+const char* ReadValue(const char* data, const char* end, T* value) {
+  if (data == nullptr || end - data < (std::ptrdiff_t) sizeof(T)) {
+    return nullptr;
+  }
+  memcpy(value, data, sizeof(T));
+  return data + sizeof(T);
+}
+
+// The fields written by TreeNode::AppendSnapshot, before the evaluations.
+struct TreeNodeSnapshot {
+  Eval lower;
+  Eval upper;
+  Eval weak_lower;
+  Eval weak_upper;
+  Square eval_depth;
+  EvalLarge leaf_eval;
+  NVisited descendants;
+  uint8_t n_evaluations;
+};
+
+// Returns the position of the evaluations, or nullptr if [data, end) does not
+// contain valid fields.
+const char* ReadTreeNodeSnapshot(const char* data, const char* end, TreeNodeSnapshot* snapshot) {
+  data = ReadValue(data, end, &snapshot->lower);
+  data = ReadValue(data, end, &snapshot->upper);
+  data = ReadValue(data, end, &snapshot->weak_lower);
+  data = ReadValue(data, end, &snapshot->weak_upper);
+  data = ReadValue(data, end, &snapshot->eval_depth);
+  data = ReadValue(data, end, &snapshot->leaf_eval);
+  data = ReadValue(data, end, &snapshot->descendants);
+  data = ReadValue(data, end, &snapshot->n_evaluations);
+  if (data == nullptr) {
+    return nullptr;
+  }
+  Eval lower = snapshot->lower;
+  Eval upper = snapshot->upper;
+  Eval weak_lower = snapshot->weak_lower;
+  Eval weak_upper = snapshot->weak_upper;
+  uint8_t n_evaluations = snapshot->n_evaluations;
+  if (lower < kMinEval || lower > upper || upper > kMaxEval
+      || weak_lower < kMinEval + 1 || weak_lower > weak_upper || weak_upper > kMaxEval - 1
+      || (weak_lower - kMinEval) % 2 != 1 || (weak_upper - kMinEval) % 2 != 1
+      || (n_evaluations != 0 && n_evaluations != (weak_upper - weak_lower) / 2 + 1)
+      || (uint64_t) (end - data) < n_evaluations * sizeof(Evaluation)) {
+    return nullptr;
+  }
+  return data;
+}
+
+}  // namespace
+
+void TreeNode::AppendSnapshot(std::vector<char>* result) const {
+  auto guard = GetGuard();
+  AppendValue(result, lower_);
+  AppendValue(result, upper_);
+  AppendValue(result, weak_lower_);
+  AppendValue(result, weak_upper_);
+  AppendValue(result, eval_depth_);
+  AppendValue(result, leaf_eval_);
+  AppendValue(result, descendants_.load());
+  uint8_t n_evaluations = evaluations_ == nullptr ? 0 : (uint8_t) ((weak_upper_ - weak_lower_) / 2 + 1);
+  AppendValue(result, n_evaluations);
+  if (n_evaluations > 0) {
+    const char* start = (const char*) (evaluations_ + ToEvaluationIndex(weak_lower_));
+    result->insert(result->end(), start, start + n_evaluations * sizeof(Evaluation));
+  }
+}
+
+const char* TreeNode::CheckSnapshot(const char* data, const char* end) {
+  TreeNodeSnapshot snapshot;
+  data = ReadTreeNodeSnapshot(data, end, &snapshot);
+  return data == nullptr ? nullptr : data + snapshot.n_evaluations * sizeof(Evaluation);
+}
+
+const char* TreeNode::RestoreSnapshot(const char* data, const char* end) {
+  auto guard = GetGuard();
+  TreeNodeSnapshot snapshot;
+  data = ReadTreeNodeSnapshot(data, end, &snapshot);
+  if (data == nullptr) {
+    return nullptr;
+  }
+  lower_ = snapshot.lower;
+  upper_ = snapshot.upper;
+  weak_lower_ = snapshot.weak_lower;
+  weak_upper_ = snapshot.weak_upper;
+  eval_depth_ = snapshot.eval_depth;
+  leaf_eval_ = snapshot.leaf_eval;
+  descendants_ = snapshot.descendants;
+  ++version_;
+  if (snapshot.n_evaluations > 0) {
+    EnlargeEvaluations();
+    memcpy(evaluations_ + ToEvaluationIndex(weak_lower_), data, snapshot.n_evaluations * sizeof(Evaluation));
+    data += snapshot.n_evaluations * sizeof(Evaluation);
+  }
+  return data;
+}
+
 void TreeNode::Reset(BitPattern player, BitPattern opponent, int depth,
                      uint8_t evaluator) {
-  mutex_ = &TreeNode::mutex_at_depth_[depth % 120][Hash<kMutexAtDepthBits>(player, opponent)];
+  mutex_index_ = (depth % 120) * kMutexAtDepthSize + Hash<kMutexAtDepthBits>(player, opponent);
   auto guard = GetGuard();
   ResetNoLock(player, opponent, depth, evaluator);
 }
 
 void TreeNode::ResetNoLock(
     BitPattern player, BitPattern opponent, int depth, uint8_t evaluator) {
-  if (evaluations_ != nullptr) {
-    free(evaluations_);
-    evaluations_ = nullptr;
-  }
+  FreeEvaluations();
   player_ = player;
   opponent_ = opponent;
   n_empties_ = ::NEmpties(player, opponent);
@@ -130,15 +222,23 @@ void TreeNode::ResetNoLock(
   descendants_ = 0;
 
   leaf_eval_ = kLessThenMinEvalLarge;
+  ++version_;
 }
 
 void TreeNode::SetChildren(const std::vector<TreeNode*>& children, const EvaluatorDerivative& evaluator) {
   auto guard = GetGuard();
   auto [weak_lower, weak_upper] = evaluator.GetWeakLowerUpper(Depth());
+  UniteWeakLowerUpper(weak_lower, weak_upper);
   for (TreeNode* child : children) {
     auto child_guard = child->GetGuard();
     if (child->IsLeafNoLock()) {
       child->UpdateLeafWeakLowerUpper(-weak_upper, -weak_lower);
+    } else if (child->Evaluator() == kSharedEvaluator) {
+      // The child might come from another evaluator, with a different window.
+      if (child->weak_lower_ > -weak_upper || child->weak_upper_ < -weak_lower) {
+        child_guard.reset();
+        child->ExtendEvalInternal(-weak_upper, -weak_lower);
+      }
     } else {
       // This fixes a weird edge case where ExtendEval fails:
       // 1. We ExtendEval on a leaf N.
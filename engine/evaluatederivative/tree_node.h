@@ -31,9 +31,11 @@
 #include <set>
 #include <stdexcept>
 #include <string.h>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "evaluation.h"
+#include "evaluation_arena.h"
 #include "../board/bitpattern.h"
 #include "../board/board.h"
 #include "../board/get_moves.h"
@@ -41,6 +43,16 @@
 #include "../utils/serializable_boolean_vector.h"
 
 constexpr float kProbIncreaseWeakEval = 0.05F;
+// Number of evaluations for all the goals in [-63, 63].
+constexpr int kNumEvaluations = 64;
+// A position has at most 60 empty squares, hence at most 60 moves (or 1 pass).
+constexpr int kMaxChildren = 64;
+// Evaluator index of the nodes shared by all the evaluators of a
+// TreeNodeSupplier (see EvaluatorDerivative::SetShareTranspositions). The
+// indices of the evaluators must be smaller.
+constexpr uint8_t kSharedEvaluator = 254;
+// Evaluator index of the nodes not reset by any evaluator yet.
+constexpr uint8_t kNoEvaluator = 255;
 
 class ChildError: public std::exception {
  public:
@@ -65,16 +77,22 @@ class Node {
   Node() :
       evaluations_(nullptr),
       leaf_eval_(kLessThenMinEvalLarge),
-      evaluator_(255),
-      is_leaf_(true) {}
+      mutex_index_(0),
+      is_leaf_(true),
+      n_threads_working_(0),
+      evaluator_(kNoEvaluator),
+      evaluations_arena_(nullptr) {}
 
   Node(const Node& other) :
-      player_(other.player_),
-      opponent_(other.opponent_),
+      // We need to set evaluations_ to nullptr otherwise it tries to free it.
       evaluations_(nullptr),
+      mutex_index_(0),
+      is_leaf_(other.is_leaf_),
+      n_threads_working_(0),
       n_empties_(other.n_empties_),
-      // We need to set evaluations_ to nullptr otherwise it tries to free it.
-      is_leaf_(other.is_leaf_) {
+      player_(other.player_),
+      opponent_(other.opponent_),
+      evaluations_arena_(nullptr) {
     FromOther(other);
   }
 
@@ -83,19 +101,14 @@ class Node {
   Node(const Node* const other) : Node(*other) {}
 
   virtual ~Node() {
-    if (evaluations_ != nullptr) {
-      free(evaluations_);
-    }
+    FreeEvaluations();
   }
 
   void FromOther(const Node& other) {
     assert(Board(player_, opponent_).Unique() == other.ToBoard().Unique());
     assert(n_empties_ == other.n_empties_);
 
-    if (evaluations_ != nullptr) {
-      free(evaluations_);
-    }
-    evaluations_ = nullptr;
+    FreeEvaluations();
     descendants_ = other.descendants_.load();
     leaf_eval_ = other.leaf_eval_;
     lower_ = other.lower_;
@@ -111,7 +124,10 @@ class Node {
     }
   }
 
-  static Node Deserialize(const std::vector<char>& serialized, int version, std::vector<CompressedFlip>* father_flips) {
+  // Serialized is a std::vector<char> or anything with the same operator[],
+  // begin(), end() and size() (e.g., a view of a memory mapped file).
+  template<class Serialized>
+  static Node Deserialize(const Serialized& serialized, int version, std::vector<CompressedFlip>* father_flips) {
     Node n;
     Board board = Board::Deserialize(serialized.begin());
     n.player_ = board.Player();
@@ -135,7 +151,9 @@ class Node {
       }
     }
 
-    n.descendants_ = (NVisited) *((float*) &(serialized[i]));
+    float descendants;
+    memcpy(&descendants, serialized.data() + i, sizeof(float));
+    n.descendants_ = (NVisited) descendants;
     i += sizeof(float);
     n.lower_ = (Eval) serialized[i++];
     n.upper_ = (Eval) serialized[i++];
@@ -370,9 +388,25 @@ class Node {
     return (eval - min_evaluation_) >> 1;
   }
 
+  // NOTE: The content of evaluations_ is not preserved (min_evaluation_ might
+  // change): callers always recompute it.
   void EnlargeEvaluations() {
+    ++version_;
     min_evaluation_ = weak_lower_;
     int desired_size = ToEvaluationIndex(weak_upper_) + 1;
+    if (evaluations_arena_ != nullptr) {
+      if (desired_size <= evaluations_capacity_) {
+        return;
+      }
+      int capacity = EvaluationArena::Capacity(desired_size);
+      Evaluation* evaluations = evaluations_arena_->Allocate(capacity);
+      FreeEvaluations();
+      if (evaluations != nullptr) {
+        evaluations_ = evaluations;
+        evaluations_capacity_ = (uint8_t) capacity;
+        return;
+      }
+    }
     if (evaluations_) {
       evaluations_ = (Evaluation*) realloc(evaluations_, desired_size * sizeof(Evaluation));
     } else {
@@ -380,6 +414,12 @@ class Node {
     }
   }
 
+  // Nodes with an arena allocate evaluations_ from it instead of the heap.
+  void SetEvaluationArena(EvaluationArena* arena) {
+    FreeEvaluations();
+    evaluations_arena_ = arena;
+  }
+
   void AddDescendants(NVisited n) { descendants_ += n; }
 
   void ResetDescendants() { descendants_ = 0; }
@@ -418,11 +458,13 @@ class Node {
   void SetUpper(Eval upper) {
     upper_ = std::min(upper, upper_);
     leaf_eval_ = std::min(leaf_eval_, EvalToEvalLarge(upper_));
+    ++version_;
   }
 
   void SetLower(Eval lower) {
     lower_ = std::max(lower, lower_);
     leaf_eval_ = std::max(leaf_eval_, EvalToEvalLarge(lower_));
+    ++version_;
   }
 
   // Measures the progress towards solving the position (lower is better).
@@ -497,21 +539,46 @@ class Node {
   }
 
  protected:
-  BitPattern player_;
-  BitPattern opponent_;
-  std::atomic_uint64_t descendants_;
+  // Hot fields: TreeNode::BestChild reads them on every child. They fit in
+  // the first 32 bytes (with the vtable pointer), so that they are on a single
+  // cache line in the TreeNodeSupplier array (see alignas in TreeNode).
   Evaluation* evaluations_;
   EvalLarge leaf_eval_;
-  Square n_empties_;
+  // Only used by TreeNode (index in TreeNode::mutex_at_depth_).
+  uint32_t mutex_index_;
   Eval lower_;
   Eval upper_;
   Eval weak_lower_;
   Eval weak_upper_;
   Eval min_evaluation_;
+  bool is_leaf_;
+  // Only used by TreeNode.
+  std::atomic_uint8_t n_threads_working_;
+
+  // Cold fields.
+  Square n_empties_;
   Square depth_;
   Square eval_depth_;
   uint8_t evaluator_;
-  bool is_leaf_;
+  // Size of evaluations_ if it comes from evaluations_arena_, 0 if it comes
+  // from malloc.
+  uint8_t evaluations_capacity_ = 0;
+  // Incremented by every writer of the bounds, leaf_eval_ or the evaluations
+  // (directly or via EnlargeEvaluations), so that TreeNode::UpdateFather
+  // detects any concurrent change.
+  uint32_t version_ = 0;
+  std::atomic_uint64_t descendants_;
+  BitPattern player_;
+  BitPattern opponent_;
+  EvaluationArena* evaluations_arena_;
+
+  void FreeEvaluations() {
+    if (evaluations_ != nullptr && evaluations_capacity_ == 0) {
+      free(evaluations_);
+    }
+    evaluations_ = nullptr;
+    evaluations_capacity_ = 0;
+  }
 
   void UpdateLeafEvaluation(int i) {
     assert(i >= weak_lower_ && i <= weak_upper_);
@@ -546,7 +613,8 @@ class Node {
   }
 };
 
-class TreeNode : public Node {
+// Aligned so that the hot fields of Node never straddle two cache lines.
+class alignas(32) TreeNode : public Node {
  public:
   TreeNode(const TreeNode&) = delete;
 
@@ -555,16 +623,14 @@ class TreeNode : public Node {
       children_(nullptr),
       fathers_(nullptr),
       n_fathers_(0),
-      n_children_(0),
-      n_threads_working_(0) {}
+      n_children_(0) {}
 
   TreeNode() :
       Node(),
       children_(nullptr),
       fathers_(nullptr),
       n_fathers_(0),
-      n_children_(0),
-      n_threads_working_(0) {}
+      n_children_(0) {}
 
   ~TreeNode() {
     if (n_fathers_ != 0) {
@@ -584,6 +650,20 @@ class TreeNode : public Node {
 
   void SetSolved(EvalLarge lower, EvalLarge upper, const EvaluatorDerivative& evaluator_derivative);
 
+  // Appends bounds, leaf eval, descendants and evaluations of this node to
+  // `result`, without board, depth and children (see
+  // EvaluatorDerivative::SaveSnapshot).
+  void AppendSnapshot(std::vector<char>* result) const;
+
+  // Restores the fields written by AppendSnapshot on a node just reset.
+  // Returns the position after them, or nullptr (without changing the node)
+  // if [data, end) does not contain valid fields.
+  const char* RestoreSnapshot(const char* data, const char* end);
+
+  // Returns the position after the fields written by AppendSnapshot, or
+  // nullptr if [data, end) does not contain valid fields.
+  static const char* CheckSnapshot(const char* data, const char* end);
+
   void SetSolvedNoUpdate(EvalLarge lower, EvalLarge upper) {
     assert(lower % 16 == 0);
     assert(upper % 16 == 0);
@@ -595,6 +675,7 @@ class TreeNode : public Node {
     Eval upper_small = EvalLargeToEvalRound(upper);
     lower_ = MaxEval(lower_, lower_small);
     upper_ = MinEval(upper_, upper_small);
+    ++version_;
     assert(lower_ <= 64);
     assert(upper_ >= -64);
   }
@@ -624,26 +705,89 @@ class TreeNode : public Node {
     return locked;
   }
 
-  void UpdateFathers() {
-    // Use an index to avoid co-modification (if some other thread adds fathers in the meantime).
-    unsigned int n_fathers;
-    {
+  // Updates all the ancestors of this node. With transpositions, the same
+  // ancestor can be reached through many paths: it is updated only once, after
+  // all its children that are also ancestors of this node. Returns the number
+  // of UpdateFather calls.
+  int UpdateFathers() {
+    return UpdateFathers({this});
+  }
+
+  // Same as UpdateFathers(), for the ancestors of all the nodes at once (e.g.,
+  // sibling leaves expanded in the same descent share all their ancestors,
+  // which are updated only once).
+  static int UpdateFathers(const std::vector<TreeNode*>& nodes) {
+    // For each ancestor, the number of fathers_ entries pointing to it among
+    // the nodes and the other ancestors (i.e., the children to update first),
+    // and the number of its fathers when it was visited.
+    std::unordered_map<TreeNode*, std::pair<int, unsigned int>> ancestors;
+    std::vector<TreeNode*> stack;
+    std::vector<unsigned int> n_fathers;
+    for (TreeNode* node : nodes) {
+      n_fathers.push_back(node->NFathers());
+      node->VisitFathers(n_fathers.back(), &ancestors, &stack);
+    }
+    while (!stack.empty()) {
+      TreeNode* node = stack.back();
+      stack.pop_back();
+      node->VisitFathers(ancestors[node].second, &ancestors, &stack);
+    }
+    // Same as stack, but for the ancestors whose children are all updated.
+    std::vector<TreeNode*> to_update;
+    for (int i = 0; i < (int) nodes.size(); ++i) {
+      nodes[i]->ReleaseFathers(n_fathers[i], &ancestors, &to_update);
+    }
+    int n_updated = 0;
+    while (!to_update.empty()) {
+      TreeNode* node = to_update.back();
+      to_update.pop_back();
+      assert(!node->IsLeaf());
+      node->UpdateFather();
+      ++n_updated;
+      node->ReleaseFathers(ancestors[node].second, &ancestors, &to_update);
+    }
+    assert(n_updated == (int) ancestors.size());
+    return n_updated;
+  }
+
+  // Optimistic version of UpdateFatherNoLock: computes the update without
+  // holding this node's lock (so that BestChild and other updates are not
+  // blocked), then publishes it if no other update happened in the meantime,
+  // otherwise retries.
+  virtual void UpdateFather() {
+    Evaluation evaluations[kNumEvaluations];
+    while (true) {
+      uint32_t version;
+      Eval lower, upper, weak_lower, weak_upper, min_evaluation;
+      {
+        auto guard = GetGuard();
+        version = version_;
+        lower = lower_;
+        upper = upper_;
+        weak_lower = weak_lower_;
+        weak_upper = weak_upper_;
+        min_evaluation = min_evaluation_;
+        assert(!IsLeafNoLock());
+      }
+      EvalLarge leaf_eval;
+      UpdateFromChildren(lower, upper, weak_lower, weak_upper, leaf_eval, min_evaluation, evaluations);
       auto guard = GetGuard();
-      n_fathers = n_fathers_;
-    }
-    for (unsigned int i = 0; i < n_fathers; ++i) {
-      TreeNode* father = fathers_[i];
-      assert(!father->IsLeaf());
-      father->UpdateFather();
-      father->UpdateFathers();
+      if (version_ != version) {
+        continue;
+      }
+      lower_ = lower;
+      upper_ = upper;
+      weak_lower_ = weak_lower;
+      weak_upper_ = weak_upper;
+      leaf_eval_ = leaf_eval;
+      for (int i = MaxEval(lower_ + 1, weak_lower_); i <= MinEval(upper_ - 1, weak_upper_); i += 2) {
+        *MutableEvaluation(i) = evaluations[ToEvaluationIndex(i)];
+      }
+      ++version_;
+      return;
     }
   }
 
-  virtual void UpdateFather() {
-    auto guard = GetGuard();
-    UpdateFatherNoLock();
-  }
-
   std::vector<Node> GetChildren() {
     auto guard = GetGuard();
     std::vector<Node> children;
@@ -715,30 +859,84 @@ class TreeNode : public Node {
     if (eval_goal < weak_lower_ || eval_goal > weak_upper_ || Node::IsSolved(eval_goal, eval_goal, false)) {
       return nullptr;
     }
-    double best_child_value = -DBL_MAX;
-    TreeNode* best_child = nullptr;
+    // First copy what GetValue needs from each child (under the child's lock)
+    // into contiguous arrays, then score all the children in one loop without
+    // locks or pointer chasing.
+    const Evaluation& father_eval = GetEvaluation(eval_goal);
+    bool use_log_derivative = father_eval.ProbGreaterEqual() < 0.99;
+    TreeNode* candidates[kMaxChildren];
+    double base_value[kMaxChildren];
+    double leaf_eval[kMaxChildren];
+    float n_threads_working[kMaxChildren];
+    int n_candidates = 0;
     auto start = ChildrenStart();
     auto end = ChildrenEnd();
     int child_eval_goal = -eval_goal;
     for (auto iter = start; iter != end; ++iter) {
       TreeNode* child = *iter;
       auto child_guard = child->GetGuard();
-      if (child_eval_goal <= child->lower_ || child_eval_goal >= child->upper_ ||
-          child_eval_goal < child->weak_lower_ || child_eval_goal > child->weak_upper_) {
+      if (!child->IsValidChildNoLock(child_eval_goal)) {
         continue;
       }
-      assert(!child->Node::IsSolved(child_eval_goal, child_eval_goal, false));
-      assert(!child->GetEvaluation(child_eval_goal).IsSolved());
-//      assert(father_eval.ProbGreaterEqual() >= 1 - child->GetEvaluation(child_eval_goal).ProbGreaterEqual() - 0.001);
-      double cur_loss = child->GetValue(*this, child_eval_goal, n_thread_multiplier);
-      if (cur_loss > best_child_value) {
-        best_child = child;
-        best_child_value = cur_loss;
+      const Evaluation& child_eval = child->GetEvaluation(child_eval_goal);
+      candidates[n_candidates] = child;
+      base_value[n_candidates] = use_log_derivative ?
+          child_eval.LogDerivative(father_eval) : -child_eval.DisproofNumberSmall();
+      leaf_eval[n_candidates] = child->leaf_eval_;
+      n_threads_working[n_candidates] = n_thread_multiplier * child->NThreadsWorking();
+      ++n_candidates;
+    }
+    // Same as GetValue.
+    double value[kMaxChildren];
+    if (use_log_derivative) {
+      double prob_lower_cubed = father_eval.ProbLowerCubed();
+      for (int i = 0; i < n_candidates; ++i) {
+        value[i] = base_value[i] - leaf_eval[i] / (double) (kMaxEvalLarge - kMinEvalLarge)
+                   - n_threads_working[i] * prob_lower_cubed;
+      }
+    } else {
+      for (int i = 0; i < n_candidates; ++i) {
+        value[i] = base_value[i] - 0.4 * leaf_eval[i] / 8.0;
+      }
+    }
+    double best_child_value = -DBL_MAX;
+    TreeNode* best_child = nullptr;
+    for (int i = 0; i < n_candidates; ++i) {
+      if (value[i] > best_child_value) {
+        best_child = candidates[i];
+        best_child_value = value[i];
       }
     }
     return best_child;
   }
 
+  // The children that are leaves and that BestChild could return, sorted by
+  // decreasing value.
+  std::vector<TreeNode*> BestLeafChildren(int eval_goal, float n_thread_multiplier) {
+    auto guard = GetGuard();
+    std::vector<std::pair<double, TreeNode*>> leaves;
+    if (IsLeafNoLock() || eval_goal < weak_lower_ || eval_goal > weak_upper_) {
+      return {};
+    }
+    auto start = ChildrenStart();
+    auto end = ChildrenEnd();
+    int child_eval_goal = -eval_goal;
+    for (auto iter = start; iter != end; ++iter) {
+      TreeNode* child = *iter;
+      auto child_guard = child->GetGuard();
+      if (!child->IsLeafNoLock() || !child->IsValidChildNoLock(child_eval_goal)) {
+        continue;
+      }
+      leaves.emplace_back(child->GetValue(*this, child_eval_goal, n_thread_multiplier), child);
+    }
+    std::sort(leaves.begin(), leaves.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<TreeNode*> result;
+    for (const auto& [value, child] : leaves) {
+      result.push_back(child);
+    }
+    return result;
+  }
+
   virtual TreeNode** ChildrenStart() {
     return children_;
   }
@@ -863,6 +1061,7 @@ class TreeNode : public Node {
              GetEvaluation(i).ProbGreaterEqual() < 1);
     }
     leaf_eval_ = 4;
+    ++version_;
   }
 
   virtual void SetLeafEval(EvalLarge leaf_eval, Square eval_depth) {
@@ -877,12 +1076,14 @@ class TreeNode : public Node {
     eval_depth_ = eval_depth;
     leaf_eval_ = std::max(
         EvalToEvalLarge(lower_), std::min(EvalToEvalLarge(upper_), leaf_eval));
+    ++version_;
     assert(leaf_eval_ >= EvalToEvalLarge(lower_) && leaf_eval_ <= EvalToEvalLarge(upper_));
   }
 
   void UpdateLeafWeakLowerUpper(Eval weak_lower, Eval weak_upper) {
     assert(IsLeafNoLock());
     assert(weak_lower <= weak_upper);
+    UniteWeakLowerUpper(weak_lower, weak_upper);
     weak_lower_ = weak_lower;
     weak_upper_ = weak_upper;
     EnlargeEvaluations();
@@ -892,6 +1093,7 @@ class TreeNode : public Node {
 
   void SetChildrenNoUpdate(const std::vector<TreeNode*>& children) {
     assert(n_children_ == 0 || n_children_ == 255);
+    assert(children.size() <= kMaxChildren);
     n_children_ = (Square) children.size();
     children_ = new TreeNode*[n_children_];
     is_leaf_ = false;
@@ -903,19 +1105,17 @@ class TreeNode : public Node {
   }
 
  protected:
-  std::mutex* mutex_;
   TreeNode** children_;
   TreeNode** fathers_;
   uint32_t n_fathers_;
   Square n_children_;
-  std::atomic_uint8_t n_threads_working_;
   static std::atomic_bool extend_eval_failed_;
-  static std::vector<std::vector<std::mutex>> mutex_at_depth_;
+  static std::vector<std::mutex> mutex_at_depth_;
 
   friend std::ostream& operator<<(std::ostream& stream, const TreeNode& n);
   
   virtual std::optional<std::lock_guard<std::mutex>> GetGuard() const {
-    return std::optional<std::lock_guard<std::mutex>>{*mutex_};
+    return std::optional<std::lock_guard<std::mutex>>{mutex_at_depth_[mutex_index_]};
   }
 
   void ExtendEvalInternal(Eval weak_lower, Eval weak_upper) {
@@ -930,12 +1130,14 @@ class TreeNode : public Node {
         UpdateLeafWeakLowerUpper(weak_lower, weak_upper);
         return;
       }
+      UniteWeakLowerUpper(weak_lower, weak_upper);
     }
     for (int i = 0; i < n_children_; ++i) {
       children_[i]->ExtendEvalInternal(-weak_upper, -weak_lower);
     }
     {
       auto guard = GetGuard();
+      UniteWeakLowerUpper(weak_lower, weak_upper);
       weak_lower_ = weak_lower;
       weak_upper_ = weak_upper;
       assert(weak_lower_ <= weak_upper_);
@@ -944,6 +1146,15 @@ class TreeNode : public Node {
     }
   }
 
+  // Shared nodes can have fathers in several evaluators, each needing its own
+  // window: never narrow the current one.
+  void UniteWeakLowerUpper(Eval& weak_lower, Eval& weak_upper) const {
+    if (evaluator_ == kSharedEvaluator && evaluations_ != nullptr) {
+      weak_lower = std::min(weak_lower, weak_lower_);
+      weak_upper = std::max(weak_upper, weak_upper_);
+    }
+  }
+
   void UpdateLeafEvaluations() {
     assert(IsLeafNoLock());
     for (int i = MaxEval(lower_ + 1, weak_lower_); i <= MinEval(upper_ - 1, weak_upper_); i += 2) {
@@ -975,31 +1186,61 @@ class TreeNode : public Node {
       BitPattern player, BitPattern opponent, int depth, uint8_t evaluator);
 
   void UpdateFatherNoLock() {
-    assert((weak_lower_ - kMinEval) % 2 == 1);
-    assert((weak_upper_ - kMinEval) % 2 == 1);
-    assert((lower_ - kMinEval) % 2 == 0);
-    assert((upper_ - kMinEval) % 2 == 0);
     assert(!IsLeafNoLock());
-    Eval new_upper = lower_;
-    leaf_eval_ = EvalToEvalLarge(lower_);
-    for (int i = std::max(lower_ + 1, (int) weak_lower_); i <= std::min(upper_ - 1, (int) weak_upper_); i += 2) {
-      MutableEvaluation(i)->Initialize();
+    UpdateFromChildren(lower_, upper_, weak_lower_, weak_upper_, leaf_eval_, min_evaluation_, evaluations_);
+    ++version_;
+  }
+
+  // Recomputes lower, upper, weak_lower, weak_upper, leaf_eval and the
+  // evaluations of this node from its children, starting from the current
+  // lower, upper, weak_lower and weak_upper. The evaluations are indexed from
+  // min_evaluation (like evaluations_); only the ones in
+  // [max(lower + 1, weak_lower), min(upper - 1, weak_upper)] are meaningful
+  // at the end. Does not lock this node (only its children).
+  void UpdateFromChildren(
+      Eval& lower, Eval& upper, Eval& weak_lower, Eval& weak_upper,
+      EvalLarge& leaf_eval, Eval min_evaluation, Evaluation* evaluations) {
+    assert((weak_lower - kMinEval) % 2 == 1);
+    assert((weak_upper - kMinEval) % 2 == 1);
+    assert((lower - kMinEval) % 2 == 0);
+    assert((upper - kMinEval) % 2 == 0);
+    assert(min_evaluation <= weak_lower);
+    Eval new_upper = lower;
+    leaf_eval = EvalToEvalLarge(lower);
+    for (int i = std::max(lower + 1, (int) weak_lower); i <= std::min(upper - 1, (int) weak_upper); i += 2) {
+      evaluations[(i - min_evaluation) >> 1].Initialize();
     }
     auto start = ChildrenStart();
     auto end = ChildrenEnd();
-    for (auto child = start; child != end; ++child) {
-      UpdateWithChild(**child);
-      new_upper = MaxEval(new_upper, (Eval) -(*child)->Lower());
+    for (auto iter = start; iter != end; ++iter) {
+      const TreeNode& child = **iter;
+      auto child_guard = child.GetGuard();
+      assert(child.leaf_eval_ >= EvalToEvalLarge(child.lower_) && child.leaf_eval_ <= EvalToEvalLarge(child.upper_));
+      lower = MaxEval(lower, (Eval) -child.upper_);
+      leaf_eval = std::max(leaf_eval, -child.leaf_eval_);
+      // TODO: Make weak_lower >= lower to avoid extra computations.
+      weak_lower = MaxEval(weak_lower, (Eval) -child.weak_upper_);
+      weak_upper = MinEval(weak_upper, (Eval) -child.weak_lower_);
+      for (int i = std::max(lower + 1, (int) weak_lower); i <= std::min(upper - 1, (int) weak_upper); i += 2) {
+        assert(-i >= child.weak_lower_ && -i <= child.weak_upper_);
+        assert(-i <= child.upper_);
+        if (-i < child.lower_) {
+          continue;
+        }
+        evaluations[(i - min_evaluation) >> 1].UpdateFatherWithThisChild(child.GetEvaluation(-i));
+      }
+      assert(weak_lower <= weak_upper);
+      new_upper = MaxEval(new_upper, (Eval) -child.lower_);
     }
-    if (new_upper < upper_) {
-      upper_ = new_upper;
+    if (new_upper < upper) {
+      upper = new_upper;
     }
-    leaf_eval_ = std::min(leaf_eval_, EvalToEvalLarge(upper_));
-    for (int i = MaxEval(lower_ + 1, weak_lower_); i <= MinEval(upper_ - 1, weak_upper_); i += 2) {
-      MutableEvaluation(i)->Finalize();
+    leaf_eval = std::min(leaf_eval, EvalToEvalLarge(upper));
+    for (int i = MaxEval(lower + 1, weak_lower); i <= MinEval(upper - 1, weak_upper); i += 2) {
+      evaluations[(i - min_evaluation) >> 1].Finalize();
     }
-    assert(kMinEval <= lower_ && lower_ <= upper_ && upper_ <= kMaxEval);
-    assert(leaf_eval_ >= EvalToEvalLarge(lower_) && leaf_eval_ <= EvalToEvalLarge(upper_));
+    assert(kMinEval <= lower && lower <= upper && upper <= kMaxEval);
+    assert(leaf_eval >= EvalToEvalLarge(lower) && leaf_eval <= EvalToEvalLarge(upper));
   }
 
   bool IsUnderAnalyzed(const TreeNode& father, int father_eval_goal) const {
@@ -1023,6 +1264,17 @@ class TreeNode : public Node {
     }
   }
 
+  // Whether BestChild can choose this node for the goal eval_goal.
+  bool IsValidChildNoLock(int eval_goal) const {
+    if (eval_goal <= lower_ || eval_goal >= upper_ ||
+        eval_goal < weak_lower_ || eval_goal > weak_upper_) {
+      return false;
+    }
+    assert(!Node::IsSolved(eval_goal, eval_goal, false));
+    assert(!GetEvaluation(eval_goal).IsSolved());
+    return true;
+  }
+
   double GetValue(
       const TreeNode& father, int eval_goal, float n_thread_multiplier) const {
     const Evaluation& eval = GetEvaluation(eval_goal);
@@ -1039,31 +1291,6 @@ class TreeNode : public Node {
     return -eval.DisproofNumberSmall() - 0.4 * leaf_eval_ / 8.0;
   }
 
-  virtual void UpdateWithChild(const TreeNode& child) {
-    auto child_guard = child.GetGuard();
-    // We cannot check the upper, because we are currently updating it.
-    assert(leaf_eval_ >= EvalToEvalLarge(lower_));
-    assert(child.leaf_eval_ >= EvalToEvalLarge(child.lower_) && child.leaf_eval_ <= EvalToEvalLarge(child.upper_));
-    assert(min_evaluation_ <= weak_lower_);
-    lower_ = MaxEval(lower_, (Eval) -child.upper_);
-    leaf_eval_ = std::max(leaf_eval_, -child.leaf_eval_);
-    assert(leaf_eval_ >= EvalToEvalLarge(lower_));
-    // TODO: Make weak_lower_ >= lower_ to avoid extra computations.
-    weak_lower_ = MaxEval(weak_lower_, (Eval) -child.weak_upper_);
-    weak_upper_ = MinEval(weak_upper_, (Eval) -child.weak_lower_);
-    for (int i = std::max(lower_ + 1, (int) weak_lower_); i <= std::min(upper_ - 1, (int) weak_upper_); i += 2) {
-      Evaluation* father_eval = MutableEvaluation(i);
-      assert(-i >= child.weak_lower_ && -i <= child.weak_upper_);
-      assert(-i <= child.upper_);
-      if (-i < child.lower_) {
-        continue;
-      }
-      const Evaluation& eval = child.GetEvaluation(-i);
-      father_eval->UpdateFatherWithThisChild(eval);
-    }
-    assert(weak_lower_ <= weak_upper_);
-  }
-
   virtual void AddFather(TreeNode* father) {
     auto guard = GetGuard();
     if (n_fathers_ == 0) {
@@ -1076,6 +1303,40 @@ class TreeNode : public Node {
     n_fathers_++;
   }
 
+  unsigned int NFathers() const {
+    // Use the number of fathers to avoid co-modification (if some other thread
+    // adds fathers in the meantime).
+    auto guard = GetGuard();
+    return n_fathers_;
+  }
+
+  void VisitFathers(
+      unsigned int n_fathers,
+      std::unordered_map<TreeNode*, std::pair<int, unsigned int>>* ancestors,
+      std::vector<TreeNode*>* stack) const {
+    for (unsigned int i = 0; i < n_fathers; ++i) {
+      TreeNode* father = fathers_[i];
+      auto [it, inserted] = ancestors->try_emplace(father, 0, 0);
+      ++it->second.first;
+      if (inserted) {
+        it->second.second = father->NFathers();
+        stack->push_back(father);
+      }
+    }
+  }
+
+  void ReleaseFathers(
+      unsigned int n_fathers,
+      std::unordered_map<TreeNode*, std::pair<int, unsigned int>>* ancestors,
+      std::vector<TreeNode*>* to_update) const {
+    for (unsigned int i = 0; i < n_fathers; ++i) {
+      TreeNode* father = fathers_[i];
+      if (--(*ancestors)[father].first == 0) {
+        to_update->push_back(father);
+      }
+    }
+  }
+
   void SetChildrenNoLock(const std::vector<TreeNode*>& children) {
     SetChildrenNoUpdate(children);
     UpdateFatherNoLock();
@@ -1197,14 +1458,57 @@ class LeafToUpdate {
   }
   bool operator!=(const LeafToUpdate& other) const { return !operator==(other); }
 
-  void Finalize(NVisited n_visited) {
-    leaf_->UpdateFathers();
-    leaf_->AddDescendants(n_visited);
-    leaf_->DecreaseNThreadsWorking();
-    for (auto parent : Parents()) {
-      parent->AddDescendants(n_visited);
-      parent->DecreaseNThreadsWorking();
+  // Locks up to max_leaves other leaves among the children of the father of
+  // this leaf, best first, so that they can be expanded without descending
+  // again. They have the same parents as this leaf.
+  std::vector<LeafToUpdate> SiblingLeaves(int max_leaves, float n_thread_multiplier) const {
+    std::vector<LeafToUpdate> result;
+    if (parents_.empty() || max_leaves <= 0) {
+      return result;
+    }
+    for (Node* sibling : parents_.back()->BestLeafChildren(-eval_goal_, n_thread_multiplier)) {
+      if (sibling == leaf_) {
+        continue;
+      }
+      LeafToUpdate leaf(*this);
+      leaf.leaf_ = sibling;
+      leaf.alpha_ = -father_beta_;
+      leaf.beta_ = -father_alpha_;
+      sibling->template UpdateAlphaBeta<Node>(&leaf);
+      if (!sibling->TryLockLeaf(leaf.alpha_, leaf.beta_)) {
+        continue;
+      }
+      for (Node* parent : parents_) {
+        parent->IncreaseNThreadsWorking();
+      }
+      result.push_back(std::move(leaf));
+      if ((int) result.size() == max_leaves) {
+        break;
+      }
+    }
+    return result;
+  }
+
+  // Returns the number of UpdateFather calls.
+  int Finalize(NVisited n_visited) {
+    int n_updated = leaf_->UpdateFathers();
+    Release(n_visited);
+    return n_updated;
+  }
+
+  // Same as calling Finalize(n_visited[i]) on each leaf, but the common
+  // ancestors (e.g., of the leaves returned by SiblingLeaves) are updated once.
+  static int Finalize(const std::vector<LeafToUpdate>& leaves, const std::vector<NVisited>& n_visited) {
+    assert(leaves.size() == n_visited.size());
+    std::vector<TreeNode*> nodes;
+    for (const LeafToUpdate& leaf : leaves) {
+      nodes.push_back(leaf.leaf_);
+    }
+    int n_updated = TreeNode::UpdateFathers(nodes);
+    for (int i = 0; i < (int) leaves.size(); ++i) {
+      leaves[i].Release(n_visited[i]);
     }
+    return n_updated;
   }
 
  protected:
@@ -1214,19 +1518,30 @@ class LeafToUpdate {
   Eval eval_goal_;
   Eval alpha_;
   Eval beta_;
+  // Alpha and beta of the father of leaf_ (before UpdateAlphaBeta on leaf_).
+  Eval father_alpha_ = 0;
+  Eval father_beta_ = 0;
   double loss_;
 
-  void ToChild(Node* child, double extra_loss) {
-    int tmp;
+  void Release(NVisited n_visited) const {
+    leaf_->AddDescendants(n_visited);
+    leaf_->DecreaseNThreadsWorking();
+    for (auto parent : Parents()) {
+      parent->AddDescendants(n_visited);
+      parent->DecreaseNThreadsWorking();
+    }
+  }
 
+  void ToChild(Node* child, double extra_loss) {
     leaf_->IncreaseNThreadsWorking();
     assert(leaf_->NThreadsWorking() > 0);
     parents_.push_back(leaf_);
     leaf_ = child;
     eval_goal_ = -eval_goal_;
-    tmp = alpha_;
-    alpha_ = -beta_;
-    beta_ = -tmp;
+    father_alpha_ = alpha_;
+    father_beta_ = beta_;
+    alpha_ = -father_beta_;
+    beta_ = -father_alpha_;
     loss_ += extra_loss;
     leaf_->template UpdateAlphaBeta<Node>(this);
   }
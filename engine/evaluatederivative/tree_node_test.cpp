@@ -15,6 +15,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <set>
 #include "tree_node.h"
 
 // EvalGoal: +20.
@@ -72,4 +73,68 @@ TEST(TreeNodeTest, OneThread) {
   #endif
   e6.UpdateFathers();
   EXPECT_EQ(e6.GetNVisited(), 40);
-}
\ No newline at end of file
+}
+void ResetLeaf(TreeNode* node, const std::string& sequence, int depth, Eval eval) {
+  node->Reset(Board(sequence.c_str()), depth, 1);
+  node->SetLeafEval(EvalToEvalLarge(eval), 4);
+  node->UpdateLeafWeakLowerUpper(-63, 63);
+}
+
+TEST(TreeNodeTest, BestLeafChildren) {
+  TreeNode e6, e6f4, e6f6, e6d6;
+  ResetLeaf(&e6, "e6", 0, 0);
+  ResetLeaf(&e6f4, "e6f4", 1, 2);
+  ResetLeaf(&e6f6, "e6f6", 1, -10);
+  ResetLeaf(&e6d6, "e6d6", 1, 6);
+  EXPECT_TRUE(e6.BestLeafChildren(1, 1).empty());
+  e6.SetChildren({&e6f4, &e6f6, &e6d6});
+
+  std::vector<TreeNode*> leaves = e6.BestLeafChildren(1, 1);
+  ASSERT_EQ(leaves.size(), 3);
+  EXPECT_EQ(leaves[0], e6.BestChild(1, 1));
+  EXPECT_EQ(std::set<TreeNode*>(leaves.begin(), leaves.end()),
+            std::set<TreeNode*>({&e6f4, &e6f6, &e6d6}));
+  EXPECT_TRUE(e6f4.BestLeafChildren(-1, 1).empty());
+}
+
+TEST(TreeNodeTest, SiblingLeaves) {
+  TreeNode e6, e6f4, e6f6, e6d6;
+  ResetLeaf(&e6, "e6", 0, 0);
+  ResetLeaf(&e6f4, "e6f4", 1, 2);
+  ResetLeaf(&e6f6, "e6f6", 1, -10);
+  ResetLeaf(&e6d6, "e6d6", 1, 6);
+  e6.SetChildren({&e6f4, &e6f6, &e6d6});
+
+  auto leaf = TreeNodeLeafToUpdate::BestDescendant(&e6, 1, kLessThenMinEval);
+  ASSERT_NE(leaf, nullptr);
+  EXPECT_EQ(leaf->Parents(), std::vector<TreeNode*>({&e6}));
+  EXPECT_TRUE(leaf->SiblingLeaves(0, 1).empty());
+
+  std::vector<TreeNodeLeafToUpdate> leaves = {*leaf};
+  for (TreeNodeLeafToUpdate& sibling : leaf->SiblingLeaves(1, 1)) {
+    leaves.push_back(sibling);
+  }
+  ASSERT_EQ(leaves.size(), 2);
+  for (TreeNodeLeafToUpdate& sibling : leaf->SiblingLeaves(5, 1)) {
+    leaves.push_back(sibling);
+  }
+  // Each sibling is locked once.
+  ASSERT_EQ(leaves.size(), 3);
+  std::set<TreeNode*> nodes;
+  for (const TreeNodeLeafToUpdate& l : leaves) {
+    EXPECT_EQ(l.Parents(), std::vector<TreeNode*>({&e6}));
+    EXPECT_EQ(l.EvalGoal(), leaf->EvalGoal());
+    EXPECT_EQ(l.Leaf()->NThreadsWorking(), 1);
+    nodes.insert(l.Leaf());
+  }
+  EXPECT_EQ(nodes, std::set<TreeNode*>({&e6f4, &e6f6, &e6d6}));
+  EXPECT_EQ(e6.NThreadsWorking(), 3);
+  EXPECT_TRUE(leaf->SiblingLeaves(5, 1).empty());
+
+  // The common father is updated once.
+  EXPECT_EQ(TreeNodeLeafToUpdate::Finalize(leaves, {10, 20, 30}), 1);
+  EXPECT_EQ(e6.NThreadsWorking(), 0);
+  for (const TreeNodeLeafToUpdate& l : leaves) {
+    EXPECT_EQ(l.Leaf()->NThreadsWorking(), 0);
+  }
+}
@@ -19,6 +19,7 @@
 #include <cstring>
 #include <memory>
 #include <optional>
+#include <vector>
 #include "../board/bitpattern.h"
 #include "../utils/constants.h"
 
@@ -106,6 +107,62 @@ class HashMap {
     return entry;
   }
 
+  // Size of an entry in a snapshot: the fields of HashMapEntry, without
+  // padding and without the busy flag.
+  static constexpr size_t kSnapshotEntrySize =
+      2 * sizeof(BitPattern) + 2 * sizeof(EvalLarge) + sizeof(DepthValue) + 2 * sizeof(Square);
+
+  // Appends the number of non-empty entries and the entries to `result`.
+  // Must not run concurrently with Update().
+  void AppendSnapshot(std::vector<char>* result) const {
+    uint64_t n_entries = 0;
+    for (const HashMapEntryInternal& entry : hash_map_) {
+      n_entries += (entry.player | entry.opponent) != 0 ? 1 : 0;
+    }
+    AppendField(result, n_entries);
+    for (const HashMapEntryInternal& entry : hash_map_) {
+      if ((entry.player | entry.opponent) != 0) {
+        AppendField(result, entry.player);
+        AppendField(result, entry.opponent);
+        AppendField(result, entry.lower);
+        AppendField(result, entry.upper);
+        AppendField(result, entry.depth);
+        AppendField(result, entry.best_move);
+        AppendField(result, entry.second_best_move);
+      }
+    }
+  }
+
+  // Restores the entries written by AppendSnapshot. Returns the position
+  // after them, or nullptr (without changing any entry) if [data, end) is
+  // too short. Must not run concurrently with other methods.
+  const char* RestoreSnapshot(const char* data, const char* end) {
+    uint64_t n_entries;
+    if (end - data < (std::ptrdiff_t) sizeof(n_entries)) {
+      return nullptr;
+    }
+    data = ReadField(data, &n_entries);
+    if ((uint64_t) (end - data) / kSnapshotEntrySize < n_entries) {
+      return nullptr;
+    }
+    for (uint64_t i = 0; i < n_entries; ++i) {
+      BitPattern player;
+      BitPattern opponent;
+      data = ReadField(data, &player);
+      data = ReadField(data, &opponent);
+      HashMapEntryInternal& entry = hash_map_[Hash(player, opponent)];
+      entry.player = player;
+      entry.opponent = opponent;
+      data = ReadField(data, &entry.lower);
+      data = ReadField(data, &entry.upper);
+      data = ReadField(data, &entry.depth);
+      data = ReadField(data, &entry.best_move);
+      data = ReadField(data, &entry.second_best_move);
+      entry.busy = false;
+    }
+    return data;
+  }
+
   bool IsAllFree() {
     for (const HashMapEntryInternal& entry : hash_map_) {
       if (entry.busy) {
@@ -117,5 +174,16 @@ class HashMap {
 
  private:
   std::vector<HashMapEntryInternal> hash_map_;
+
+  template<typename T>
+  static void AppendField(std::vector<char>* result, T value) {
+    result->insert(result->end(), (const char*) &value, (const char*) &value + sizeof(T));
+  }
+
+  template<typename T>
+  static const char* ReadField(const char* data, T* value) {
+    memcpy(value, data, sizeof(T));
+    return data + sizeof(T);
+  }
 };
 #endif  // HASH_MAP_H
\ No newline at end of file
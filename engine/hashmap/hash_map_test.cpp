@@ -65,4 +65,30 @@ TEST(HashMapTest, Parallel) {
   for (int i = 0; i < 5; ++i) {
     ASSERT_TRUE(hash_map.IsAllFree());
   }
-}
\ No newline at end of file
+}
+TEST(HashMapTest, Snapshot) {
+  HashMap<5> hash_map;
+  for (int i = 1; i < 100; ++i) {
+    hash_map.Update(i * 2, 1, i % 4, i % 8, kMinEvalLarge, kMaxEvalLarge, 10, 11);
+  }
+  std::vector<char> snapshot;
+  hash_map.AppendSnapshot(&snapshot);
+  const char* end = snapshot.data() + snapshot.size();
+
+  HashMap<5> restored;
+  EXPECT_EQ(restored.RestoreSnapshot(snapshot.data(), end - 1), nullptr);
+  EXPECT_EQ(restored.RestoreSnapshot(snapshot.data(), end), end);
+  EXPECT_TRUE(restored.IsAllFree());
+  for (int i = 1; i < 100; ++i) {
+    auto expected = hash_map.Get(i * 2, 1);
+    auto actual = restored.Get(i * 2, 1);
+    ASSERT_EQ(expected == nullptr, actual == nullptr);
+    if (expected) {
+      EXPECT_EQ(actual->lower, expected->lower);
+      EXPECT_EQ(actual->upper, expected->upper);
+      EXPECT_EQ(actual->depth, expected->depth);
+      EXPECT_EQ(actual->best_move, expected->best_move);
+      EXPECT_EQ(actual->second_best_move, expected->second_best_move);
+    }
+  }
+}
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cmath>
 #include <future>
 
@@ -315,6 +316,56 @@ double MaxTime(SenseiAction action, double seconds_on_this_node, bool first_eval
 }
 }  // namespace
 
+std::vector<std::pair<BoardToEvaluate*, int>> Engine::NextBoardsToEvaluate(double delta, int n_threads) {
+  std::vector<std::pair<double, BoardToEvaluate*>> candidates;
+  for (int i = 0; i < num_boards_to_evaluate_; ++i) {
+    BoardToEvaluate* b = boards_to_evaluate_[i].get();
+    double priority = b->Priority(delta);
+    if (priority > -DBL_MAX) {
+      candidates.emplace_back(priority, b);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), [](const auto& left, const auto& right) {
+    return left.first > right.first;
+  });
+  std::vector<double> priorities;
+  for (const auto& [priority, b] : candidates) {
+    priorities.push_back(priority);
+  }
+  std::vector<int> threads = SplitThreads(priorities, n_threads);
+  std::vector<std::pair<BoardToEvaluate*, int>> result;
+  for (int i = 0; i < (int) threads.size(); ++i) {
+    result.emplace_back(candidates[i].second, threads[i]);
+  }
+  return result;
+}
+
+std::vector<int> Engine::SplitThreads(std::vector<double> priorities, int n_threads) {
+  n_threads = std::max(1, n_threads);
+  priorities.resize(std::min((int) priorities.size(), n_threads));
+  // Drop the boards that would get less than one thread.
+  double total_priority = 0;
+  for (double priority : priorities) {
+    total_priority += priority;
+  }
+  while (priorities.size() > 1 && priorities.back() * n_threads < total_priority) {
+    total_priority -= priorities.back();
+    priorities.pop_back();
+  }
+  std::vector<int> result;
+  int remaining_threads = n_threads;
+  for (double priority : priorities) {
+    double share = total_priority > 0 ? priority / total_priority : 1.0 / priorities.size();
+    int threads = std::max(1, (int) (share * n_threads));
+    result.push_back(threads);
+    remaining_threads -= threads;
+  }
+  if (!result.empty()) {
+    result[0] += remaining_threads;
+  }
+  return result;
+}
+
 void Engine::AnalyzePosition(
     int current_thread, EvaluationState* current_state,
     const std::shared_ptr<EvaluationState>& first_state,
@@ -352,12 +403,25 @@ void Engine::AnalyzePosition(
     board_to_evaluate.EvaluateFirst(params);
   }
   for (
-      auto* board_to_evaluate = NextBoardToEvaluate(params.delta);
-      board_to_evaluate != nullptr &&
+      auto boards = NextBoardsToEvaluate(params.delta, params.n_threads);
+      !boards.empty() &&
         current_state->SecondsToEvaluateThisNode() + time.Get() < max_time - kNextEvalTime / 2 &&
         current_thread_ == current_thread;
-      board_to_evaluate = NextBoardToEvaluate(params.delta)) {
-    board_to_evaluate->Evaluate(params);
+      boards = NextBoardsToEvaluate(params.delta, params.n_threads)) {
+    // The boards share the tree nodes, so they can run at the same time.
+    std::vector<EvaluateParams> boards_params(boards.size(), params);
+    std::vector<std::future<void>> futures;
+    for (int i = 1; i < boards.size(); ++i) {
+      boards_params[i].n_threads = boards[i].second;
+      futures.push_back(std::async(
+          std::launch::async, &BoardToEvaluate::Evaluate, boards[i].first,
+          std::cref(boards_params[i])));
+    }
+    boards_params[0].n_threads = boards[0].second;
+    boards[0].first->Evaluate(boards_params[0]);
+    for (auto& future : futures) {
+      future.get();
+    }
   }
   current_state->UpdateFather();
   current_state->UpdateFathers();
@@ -18,6 +18,7 @@
 #define OTHELLO_SENSEI_ENGINE_H
 
 #include <list>
+#include <vector>
 #include <chrono>
 #include <thread>
 #include "bindings.h"
@@ -44,7 +45,10 @@ class BoardToEvaluate {
       stoppable_(false),
       started_(false),
       evaluator_(tree_node_supplier, hash_map, evaluator_depth_one_factory, index),
-      book_(book) {}
+      book_(book) {
+    // All the evaluators analyze children of the same position.
+    evaluator_.SetShareTranspositions(true);
+  }
 
   bool Finished() const { return finished_; }
 
@@ -187,8 +191,17 @@ class Engine {
     BuildThorSourceMetadata();
   }
 
+  // Given the priorities of the candidate boards, sorted by decreasing
+  // priority, returns the number of threads of each of the first boards. The
+  // boards whose share would be less than one thread are dropped; the others
+  // get at least one thread, for a total of max(1, n_threads).
+  static std::vector<int> SplitThreads(std::vector<double> priorities, int n_threads);
+
  private:
   static constexpr int kNumEvaluators = 60;
+  static_assert(kNumEvaluators <= kSharedEvaluator);
+  // Enough for the current line, its children and the recent navigation.
+  static constexpr int kBookCacheCapacity = 4096;
 
   UpdateAnnotations update_annotations_;
   [[maybe_unused]] SendMessage send_message_;
@@ -226,26 +239,17 @@ class Engine {
   }
   void BuildBook(const std::string& filepath) {
     book_ = std::make_unique<Book<kBookVersion>>(filepath);
+    book_->SetCacheCapacity(kBookCacheCapacity);
   }
   void CreateBoardsToEvaluate();
   void BuildThor(const std::string& filepath, const std::string& saved_games_filepath);
 
   void UpdateBoardsToEvaluate(EvaluationState& state, const EvaluateParams& params, bool in_analysis);
 
-  BoardToEvaluate* NextBoardToEvaluate(double delta) {
-    double highestPriority = -DBL_MAX;
-    BoardToEvaluate* result = nullptr;
-
-    for (int i = 0; i < num_boards_to_evaluate_; ++i) {
-      BoardToEvaluate& b = *boards_to_evaluate_[i];
-      double priority = b.Priority(delta);
-      if (priority > highestPriority) {
-        highestPriority = priority;
-        result = &b;
-      }
-    }
-    return result;
-  }
+  // The boards to evaluate next, with the number of threads for each one.
+  // The threads are split proportionally to the priority, and each board gets
+  // at least one, so at most n_threads boards run at the same time.
+  std::vector<std::pair<BoardToEvaluate*, int>> NextBoardsToEvaluate(double delta, int n_threads);
 
   // NOTE: Pass variables by value, to avoid concurrent modifications.
   void Run(
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <random>
+#include "engine.h"
+
+TEST(Engine, SplitThreadsOneBoard) {
+  EXPECT_EQ(Engine::SplitThreads({}, 4), std::vector<int>());
+  EXPECT_EQ(Engine::SplitThreads({3}, 4), std::vector<int>({4}));
+  EXPECT_EQ(Engine::SplitThreads({3, 2, 1}, 1), std::vector<int>({1}));
+  EXPECT_EQ(Engine::SplitThreads({3, 2, 1}, 0), std::vector<int>({1}));
+}
+
+TEST(Engine, SplitThreadsProportional) {
+  EXPECT_EQ(Engine::SplitThreads({2, 1, 1}, 4), std::vector<int>({2, 1, 1}));
+  EXPECT_EQ(Engine::SplitThreads({3, 3}, 7), std::vector<int>({4, 3}));
+  EXPECT_EQ(Engine::SplitThreads({0, 0}, 3), std::vector<int>({2, 1}));
+  // 1 * 10 < 111 and 10 * 10 < 110: both boards would get less than 1 thread.
+  EXPECT_EQ(Engine::SplitThreads({100, 10, 1}, 10), std::vector<int>({10}));
+}
+
+TEST(Engine, SplitThreadsRandom) {
+  std::mt19937 rng(42);
+  for (int i = 0; i < 10000; ++i) {
+    int n_threads = 1 + (int) (rng() % 64);
+    std::vector<double> priorities(rng() % 70);
+    for (double& priority : priorities) {
+      priority = std::uniform_real_distribution<double>(-10, 10)(rng);
+    }
+    std::sort(priorities.begin(), priorities.end(), std::greater<double>());
+    std::vector<int> threads = Engine::SplitThreads(priorities, n_threads);
+    EXPECT_EQ(threads.empty(), priorities.empty());
+    EXPECT_LE(threads.size(), n_threads);
+    int total = 0;
+    for (int t : threads) {
+      EXPECT_GE(t, 1);
+      total += t;
+    }
+    if (!threads.empty()) {
+      EXPECT_EQ(total, n_threads);
+    }
+  }
+}
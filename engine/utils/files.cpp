@@ -14,11 +14,24 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #if __APPLE__
 #include <dirent.h>
 #include <sys/stat.h>
 #endif
 
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "files.h"
 #include "misc.h"
 
@@ -147,4 +160,123 @@ std::string LoadTextFile(const std::string& filepath) {
   }
   return std::string(std::istreambuf_iterator<char>(ifstream),
                      std::istreambuf_iterator<char>());
-}
\ No newline at end of file
+}
+
+#ifdef _WIN32
+bool WriteFileSynced(const std::string& filepath, const char* data, size_t size) {
+  HANDLE file = CreateFileA(filepath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  bool success = true;
+  for (size_t written = 0; success && written < size;) {
+    DWORD result = 0;
+    DWORD to_write = (DWORD) std::min(size - written, (size_t) 1 << 30);
+    success = WriteFile(file, data + written, to_write, &result, nullptr) && result > 0;
+    written += result;
+  }
+  success = FlushFileBuffers(file) && success;
+  return CloseHandle(file) && success;
+}
+
+bool SyncFile(const std::string& filepath) {
+  HANDLE file = CreateFileA(filepath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  bool success = FlushFileBuffers(file);
+  return CloseHandle(file) && success;
+}
+
+MappedFile::MappedFile(const std::string& filepath) :
+    data_(nullptr), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr) {
+  // FILE_SHARE_WRITE lets other handles write the file while it is mapped (the
+  // view is coherent with the writes, as long as the file does not grow).
+  file_ = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  LARGE_INTEGER size;
+  if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) ||
+      size.QuadPart == 0) {
+    Unmap();
+    return;
+  }
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ == nullptr) {
+    Unmap();
+    return;
+  }
+  data_ = (const char*) MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  size_ = data_ == nullptr ? 0 : (size_t) size.QuadPart;
+}
+
+void MappedFile::Unmap() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapping_ = nullptr;
+  file_ = INVALID_HANDLE_VALUE;
+}
+#else
+bool WriteFileSynced(const std::string& filepath, const char* data, size_t size) {
+  int file = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (file < 0) {
+    return false;
+  }
+  bool success = true;
+  for (size_t written = 0; success && written < size;) {
+    ssize_t result = write(file, data + written, size - written);
+    success = result > 0;
+    written += success ? result : 0;
+  }
+  success = fsync(file) == 0 && success;
+  return close(file) == 0 && success;
+}
+
+bool SyncFile(const std::string& filepath) {
+  int file = open(filepath.c_str(), O_RDWR);
+  if (file < 0) {
+    return false;
+  }
+  bool success = fsync(file) == 0;
+  return close(file) == 0 && success;
+}
+
+MappedFile::MappedFile(const std::string& filepath) : data_(nullptr), size_(0) {
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) {
+      data_ = (const char*) data;
+      size_ = (size_t) file_stat.st_size;
+    }
+  }
+  // The mapping stays valid after closing the descriptor.
+  close(fd);
+}
+
+void MappedFile::Unmap() {
+  if (data_ != nullptr) {
+    munmap((void*) data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+#endif
+
+MappedFile::~MappedFile() {
+  Unmap();
+}
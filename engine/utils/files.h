@@ -60,4 +60,34 @@ std::string Filename(const std::string& filepath);
 
 std::string LoadTextFile(const std::string& filepath);
 
+// Replaces the content of filepath with [data, data + size), and waits until
+// it is on disk. Returns false on failure.
+bool WriteFileSynced(const std::string& filepath, const char* data, size_t size);
+
+// Waits until the writes to filepath are on disk. Returns false on failure.
+bool SyncFile(const std::string& filepath);
+
+// A read-only memory mapping of a whole file. Missing or empty files are
+// mapped to Data() == nullptr and Size() == 0.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filepath);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+ private:
+  void Unmap();
+
+  const char* data_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif
+};
+
 #endif //OTHELLOSENSEI_APP_SRC_MAIN_CPP_UTILS_FILES_H_
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <fstream>
+#include "files.h"
+
+const std::string kTempDir = "app/testdata/tmp/files_test";
+
+TEST(MappedFile, Content) {
+  std::string filename = kTempDir + "/file";
+  CreateEmptyFileWithDirectories(filename);
+  std::ofstream(filename, std::ios::binary) << "abcdef";
+  MappedFile file(filename);
+  ASSERT_EQ(file.Size(), 6);
+  EXPECT_EQ(std::string(file.Data(), file.Size()), "abcdef");
+}
+
+TEST(MappedFile, EmptyOrMissing) {
+  std::string filename = kTempDir + "/empty";
+  CreateEmptyFileWithDirectories(filename);
+  EXPECT_EQ(MappedFile(filename).Size(), 0);
+  EXPECT_EQ(MappedFile(filename).Data(), nullptr);
+  EXPECT_EQ(MappedFile(kTempDir + "/missing").Size(), 0);
+}
@@ -16,6 +16,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <type_traits>
 #include "load_training_set.h"
 #include "../board/bitpattern.h"
 #include "../board/board.h"
@@ -31,6 +32,71 @@ istream& operator>>(istream& is, EvaluatedBoard& board) {
   return is;
 }
 
+static_assert(std::is_trivially_copyable<EvaluatedBoard>::value,
+              "The binary training set format is a raw EvaluatedBoard array.");
+
+namespace {
+const std::string kTrainingSetDirectory = "testdata/training_set/";
+constexpr uint64_t kMagic = 0x315354524953534EULL;  // "NSSIRTS1"
+
+// Magic, number of sources, then size and modification time of each source.
+std::vector<uint64_t> SourcesHeader(const std::vector<std::string>& files) {
+  std::vector<uint64_t> header = {kMagic, files.size()};
+  for (const std::string& file : files) {
+    std::error_code error;
+    uint64_t size = fs::file_size(file, error);
+    int64_t time = fs::last_write_time(file, error).time_since_epoch().count();
+    header.push_back(error ? 0 : size);
+    header.push_back(error ? 0 : (uint64_t) time);
+  }
+  return header;
+}
+
+// The header of a binary set, or an empty vector if it is missing or invalid.
+std::vector<uint64_t> ReadHeader(const std::string& filepath) {
+  ifstream input(filepath, ios::binary);
+  std::vector<uint64_t> header(2);
+  if (!input.read((char*) header.data(), 2 * sizeof(uint64_t)) || header[0] != kMagic ||
+      header[1] > (fs::file_size(filepath) - 2 * sizeof(uint64_t)) / (2 * sizeof(uint64_t))) {
+    return {};
+  }
+  header.resize(2 + 2 * header[1]);
+  input.seekg(2 * sizeof(uint64_t));
+  if (!input.read((char*) (header.data() + 2), 2 * header[1] * sizeof(uint64_t))) {
+    return {};
+  }
+  return header;
+}
+
+}  // namespace
+
+EvaluatedBoards::EvaluatedBoards(const std::string& filepath) : size_(0) {
+  auto file = std::make_shared<MappedFile>(filepath);
+  const uint64_t* header = (const uint64_t*) file->Data();
+  size_t header_size = 2 * sizeof(uint64_t);
+  if (file->Size() < header_size || header[0] != kMagic ||
+      header[1] > (file->Size() - header_size) / (2 * sizeof(uint64_t))) {
+    std::cout << "WARNING: Invalid training set " << filepath << "\n";
+    return;
+  }
+  header_size += 2 * header[1] * sizeof(uint64_t);
+  if ((file->Size() - header_size) % sizeof(EvaluatedBoard) != 0) {
+    std::cout << "WARNING: Truncated training set " << filepath << "\n";
+    return;
+  }
+  size_t size = (file->Size() - header_size) / sizeof(EvaluatedBoard);
+  if (size > 0) {
+    parts_.push_back(Part {
+        file, (const EvaluatedBoard*) (file->Data() + header_size), size});
+    size_ = size;
+  }
+}
+
+void EvaluatedBoards::Append(const EvaluatedBoards& other) {
+  parts_.insert(parts_.end(), other.parts_.begin(), other.parts_.end());
+  size_ += other.size_;
+}
+
 std::vector<EvaluatedBoard> load_set(const std::vector<std::string>& files) {
   std::vector<EvaluatedBoard> result;
   for (const std::string& file : files) {
@@ -48,29 +114,74 @@ std::vector<EvaluatedBoard> load_set(const std::vector<std::string>& files) {
   return result;
 }
 
-std::vector<EvaluatedBoard> load_set(int start_year, int end_year) {
+void save_binary_set(const std::vector<EvaluatedBoard>& boards,
+                     const std::string& filepath,
+                     const std::vector<std::string>& sources) {
+  std::vector<uint64_t> header = SourcesHeader(sources);
+  std::ofstream output(filepath, ios::binary | ios::trunc);
+  output.write((const char*) header.data(),
+               (std::streamsize) (header.size() * sizeof(uint64_t)));
+  output.write((const char*) boards.data(),
+               (std::streamsize) (boards.size() * sizeof(EvaluatedBoard)));
+}
+
+size_t binary_set_header_size(const std::string& filepath) {
+  return ReadHeader(filepath).size() * sizeof(uint64_t);
+}
+
+EvaluatedBoards load_or_convert_set(const std::vector<std::string>& files,
+                                    const std::string& binary_filepath) {
+  bool any_source = false;
+  for (const std::string& file : files) {
+    any_source = any_source || FileExists(file);
+  }
+  // Without the sources (e.g., if only the binary set was copied), we cannot
+  // check that the binary set is up to date.
+  if (!FileExists(binary_filepath) ||
+      (any_source && ReadHeader(binary_filepath) != SourcesHeader(files))) {
+    std::vector<EvaluatedBoard> boards = load_set(files);
+    if (boards.empty()) {
+      // Do not cache anything if the original files are missing.
+      return EvaluatedBoards();
+    }
+    // Write to a temporary file, so that an interrupted conversion does not
+    // leave a truncated set behind.
+    std::string tmp_filepath = binary_filepath + ".tmp";
+    save_binary_set(boards, tmp_filepath, files);
+    fs::rename(tmp_filepath, binary_filepath);
+  }
+  return EvaluatedBoards(binary_filepath);
+}
+
+EvaluatedBoards load_set(int start_year, int end_year) {
   std::vector<std::string> files;
   for (int i = start_year; i <= end_year; ++i) {
     files.push_back(
-      "testdata/training_set/TrainingSet" + std::to_string(i) + ".tmp");
+      kTrainingSetDirectory + "TrainingSet" + std::to_string(i) + ".tmp");
   }
-  return load_set(files);
+  return load_or_convert_set(
+      files,
+      kTrainingSetDirectory + "TrainingSet" + std::to_string(start_year) + "_"
+      + std::to_string(end_year) + ".bin");
 }
 
-std::vector<EvaluatedBoard> load_hard_set(int last_file_number) {
+EvaluatedBoards load_hard_set(int last_file_number) {
   std::vector<std::string> files;
   for (int i = 0; i <= last_file_number; ++i) {
     files.push_back(
-      "testdata/training_set/weird_positions_result_" + std::to_string(i)
+      kTrainingSetDirectory + "weird_positions_result_" + std::to_string(i)
       + ".tmp");
   }
-  return load_set(files);
+  return load_or_convert_set(
+      files,
+      kTrainingSetDirectory + "weird_positions_result_0_"
+      + std::to_string(last_file_number) + ".bin");
 }
 
-std::vector<EvaluatedBoard> load_train_set() {
+EvaluatedBoards load_train_set() {
   return load_set(1977, 2014);
 }
 
-std::vector<EvaluatedBoard> load_test_set() {
+EvaluatedBoards load_test_set() {
   return load_set(2015, 2016);
 }
\ No newline at end of file
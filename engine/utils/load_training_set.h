@@ -18,8 +18,12 @@
 #define LOAD_TRAINING_SET_H
 
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 #include "../board/bitpattern.h"
 #include "../board/board.h"
+#include "files.h"
 
 using ::std::istream;
 
@@ -77,14 +81,89 @@ struct std::hash<EvaluatedBoard>
   }
 };
 
+// A read-only list of boards stored in the binary training set format: a
+// header with the size and modification time of the original files, then a
+// plain array of EvaluatedBoard records (host byte order, valid boards only).
+// The files are memory-mapped: copies share the mappings, and Append
+// concatenates lists without copying the boards. A file with an invalid
+// header or a truncated array gives an empty list.
+class EvaluatedBoards {
+ public:
+  class Iterator {
+   public:
+    Iterator(const EvaluatedBoards* boards, int part) :
+        boards_(boards), part_(part), index_(0) {}
+
+    const EvaluatedBoard& operator*() const {
+      return boards_->parts_[part_].boards[index_];
+    }
+    const EvaluatedBoard* operator->() const { return &**this; }
+
+    Iterator& operator++() {
+      if (++index_ == boards_->parts_[part_].size) {
+        ++part_;
+        index_ = 0;
+      }
+      return *this;
+    }
+    bool operator==(const Iterator& other) const {
+      return part_ == other.part_ && index_ == other.index_;
+    }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    const EvaluatedBoards* boards_;
+    int part_;
+    size_t index_;
+  };
+
+  EvaluatedBoards() : size_(0) {}
+  explicit EvaluatedBoards(const std::string& filepath);
+
+  void Append(const EvaluatedBoards& other);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  Iterator begin() const { return Iterator(this, 0); }
+  Iterator end() const { return Iterator(this, (int) parts_.size()); }
+
+ private:
+  struct Part {
+    std::shared_ptr<MappedFile> file;
+    const EvaluatedBoard* boards;
+    size_t size;
+  };
+  // Only non-empty parts, so that iterators never point to an empty part.
+  std::vector<Part> parts_;
+  size_t size_;
+};
+
+// Reads the original training files (one record of player, opponent, eval per
+// board, including invalid boards).
 std::vector<EvaluatedBoard> load_set(const std::vector<std::string>& files);
 
-std::vector<EvaluatedBoard> load_hard_set(int last_file_number);
+// Saves the boards in the binary format, with the header of the sources they
+// come from.
+void save_binary_set(const std::vector<EvaluatedBoard>& boards,
+                     const std::string& filepath,
+                     const std::vector<std::string>& sources = {});
+
+// The size of the header of a binary set, or 0 if the file has no valid
+// header.
+size_t binary_set_header_size(const std::string& filepath);
+
+// Maps binary_filepath; if it does not exist, or if the original training
+// files changed since it was created, it is first created from them.
+EvaluatedBoards load_or_convert_set(const std::vector<std::string>& files,
+                                    const std::string& binary_filepath);
+
+EvaluatedBoards load_hard_set(int last_file_number);
 
-std::vector<EvaluatedBoard> load_set(int start_year, int end_year);
+EvaluatedBoards load_set(int start_year, int end_year);
 
-std::vector<EvaluatedBoard> load_train_set();
+EvaluatedBoards load_train_set();
 
-std::vector<EvaluatedBoard> load_test_set();
+EvaluatedBoards load_test_set();
 
 #endif /* LOAD_TRAINING_SET_H */
\ No newline at end of file
@@ -17,11 +17,24 @@
 #include <iostream>
 #include "../board/board.h"
 #include "load_training_set.h"
+#include "misc.h"
 
+// Converts the training sets to the binary format (if needed), so that the
+// following runs of the trainers and analyzers can memory-map them.
 int main(int argc, char** argv) {
-  std::vector<EvaluatedBoard> b = load_hard_set(184);
-  std::cout << b.size() << "\n";
-  for (int i = 0; i < 120; ++i) {
-    std::cout << b[i].GetBoard() << (int) b[i].GetEval() << "\n\n";
+  ElapsedTime elapsed_time;
+  EvaluatedBoards hard_set = load_hard_set(184);
+  std::cout << "Hard set: " << hard_set.size() << " boards\n";
+  EvaluatedBoards train_set = load_train_set();
+  std::cout << "Train set: " << train_set.size() << " boards\n";
+  EvaluatedBoards test_set = load_test_set();
+  std::cout << "Test set: " << test_set.size() << " boards\n";
+  std::cout << "Loaded in " << elapsed_time.Get() << "s\n";
+  int i = 0;
+  for (const EvaluatedBoard& b : hard_set) {
+    if (i++ >= 120) {
+      break;
+    }
+    std::cout << b.GetBoard() << (int) b.GetEval() << "\n\n";
   }
 }
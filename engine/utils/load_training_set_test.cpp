@@ -0,0 +1,102 @@
+/*
+ * Copyright 2026 Michele Borassi
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <chrono>
+#include <fstream>
+#include "load_training_set.h"
+
+const std::string kTempDir = "app/testdata/tmp/load_training_set_test";
+
+// Writes the boards in the original format.
+void WriteSource(const std::string& filename, const std::vector<EvaluatedBoard>& boards) {
+  CreateEmptyFileWithDirectories(filename);
+  std::ofstream file(filename, std::ios::binary);
+  for (const EvaluatedBoard& b : boards) {
+    BitPattern player = b.GetPlayer();
+    BitPattern opponent = b.GetOpponent();
+    int eval = b.GetEval();
+    file.write((const char*) &player, sizeof(player));
+    file.write((const char*) &opponent, sizeof(opponent));
+    file.write((const char*) &eval, sizeof(eval));
+  }
+}
+
+std::vector<EvaluatedBoard> ToVector(const EvaluatedBoards& boards) {
+  std::vector<EvaluatedBoard> result;
+  for (const EvaluatedBoard& b : boards) {
+    result.push_back(b);
+  }
+  return result;
+}
+
+const std::vector<EvaluatedBoard> kBoards = {
+    EvaluatedBoard(1, 2, 10), EvaluatedBoard(4, 8, -20), EvaluatedBoard(16, 32, 30)};
+
+TEST(EvaluatedBoards, SaveLoad) {
+  std::string filename = kTempDir + "/set.bin";
+  CreateEmptyFileWithDirectories(filename);
+  save_binary_set(kBoards, filename);
+  EvaluatedBoards boards(filename);
+  EXPECT_EQ(boards.size(), 3);
+  EXPECT_EQ(ToVector(boards), kBoards);
+}
+
+TEST(EvaluatedBoards, Append) {
+  std::string filename = kTempDir + "/set.bin";
+  CreateEmptyFileWithDirectories(filename);
+  save_binary_set(kBoards, filename);
+  EvaluatedBoards boards;
+  boards.Append(EvaluatedBoards(filename));
+  boards.Append(EvaluatedBoards());
+  boards.Append(EvaluatedBoards(filename));
+  std::vector<EvaluatedBoard> expected(kBoards);
+  expected.insert(expected.end(), kBoards.begin(), kBoards.end());
+  EXPECT_EQ(boards.size(), 6);
+  EXPECT_EQ(ToVector(boards), expected);
+}
+
+TEST(EvaluatedBoards, Invalid) {
+  std::string filename = kTempDir + "/set.bin";
+  CreateEmptyFileWithDirectories(filename);
+  save_binary_set(kBoards, filename);
+  fs::resize_file(filename, fs::file_size(filename) - 1);
+  EXPECT_TRUE(EvaluatedBoards(filename).empty());
+
+  std::ofstream(filename, std::ios::binary | std::ios::trunc) << "not a training set";
+  EXPECT_TRUE(EvaluatedBoards(filename).empty());
+  EXPECT_TRUE(EvaluatedBoards(kTempDir + "/missing.bin").empty());
+}
+
+TEST(EvaluatedBoards, ConvertsAgainIfSourcesChange) {
+  std::string source = kTempDir + "/source.tmp";
+  std::string filename = kTempDir + "/converted.bin";
+  fs::remove(filename);
+  // The last board is invalid (no empties), so it is skipped.
+  WriteSource(source, {kBoards[0], kBoards[1], EvaluatedBoard(~0ULL, 0, 0)});
+  EXPECT_EQ(ToVector(load_or_convert_set({source}, filename)),
+            std::vector<EvaluatedBoard>({kBoards[0], kBoards[1]}));
+
+  // Same size: only the modification time changes. It is set explicitly, as
+  // the file system might not see that the time changed within the test.
+  fs::file_time_type time = fs::last_write_time(source);
+  WriteSource(source, kBoards);
+  fs::last_write_time(source, time + std::chrono::seconds(10));
+  EXPECT_EQ(ToVector(load_or_convert_set({source}, filename)), kBoards);
+
+  // Without the sources, the converted set is used as it is.
+  fs::remove(source);
+  EXPECT_EQ(ToVector(load_or_convert_set({source}, filename)), kBoards);
+}